@@ -0,0 +1,1203 @@
+// batch.cpp - generate, solve, pack and unpack: the batch modes over many puzzles
+#include "sudoku.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Headless generation: worker threads build puzzles and a single writer streams them out.
+int runGenerateMode(int argc, char *argv[]) {
+      const uint64_t QUEUE_CAPACITY = 1 << 12;
+
+      GenerateOptions options;
+
+      if (!parseGenerateOptions(argc, argv, &options)) {
+            std::cerr << "Usage: sudoku generate [--count N] [--threads N] [--difficulty easy|medium|hard]\n"
+                         "                       [--rating MIN-MAX] [--seed N] [--first N] [--output FILE]\n"
+                         "                       [--binary] [--minimal] [--clues N] [--symmetric]\n"
+                         "                       [--kernel auto|scalar|sse2|avx2] [--db FILE] [--distinct]\n"
+                         "                       [--stats] [--trace FILE]\n"
+                         "--rating keeps only puzzles whose grade falls in the band, which must hold one\n"
+                         "of the grades: 10 singles only, 15 ... 55 swordfish, 100 needs guessing.\n"
+                         "Puzzle i of the run is generated from (seed, i) and written in index order, so\n"
+                         "the output is the same for any --threads and --first i --count 1 with the same\n"
+                         "seed regenerates it. Text output is one 81-char line per puzzle, '.' for\n"
+                         "hidden cells; binary output is 41 bytes per puzzle, a cell per nibble.\n"
+                         "--minimal removes clues until none can go without a second solution instead of\n"
+                         "following --difficulty; --clues N stops once N clues are left and --symmetric\n"
+                         "removes them in pairs symmetric about the centre.\n"
+                         "--kernel picks how the solver propagates singles; auto takes the fastest one\n"
+                         "the CPU supports and the others are refused when it doesn't.\n"
+                         "--db FILE draws the puzzles from a database made by sudoku pack instead of\n"
+                         "generating them, within --rating or else the band of --difficulty.\n"
+                         "--distinct emits no two puzzles which are the same up to relabelling digits,\n"
+                         "swapping rows, columns, bands or stacks and transposing: a puzzle equal to an\n"
+                         "earlier one is regenerated, so which of them is kept depends on the threads.\n"
+                         "--stats reports counters and timing histograms of the generation on exit and\n"
+                         "--trace FILE writes every timed step as Chrome trace JSON.\n";
+
+            return 1;
+      }
+
+      boardPropagationKernel = options.kernel;
+      enableStats(options.statsMode);
+
+      PuzzleDb db{};
+
+      if (options.dbPath != nullptr && !openPuzzleDb(options.dbPath, &db)) {
+            std::cerr << "Can't read " << options.dbPath << " as a puzzle database." << std::endl;
+
+            return 1;
+      }
+
+      uint64_t firstRecord = 0, endRecord = 0;
+
+      if (options.dbPath != nullptr)
+            getDbRatingRange(&db, options.minRating, options.maxRating, &firstRecord, &endRecord);
+
+      if (options.dbPath != nullptr && firstRecord >= endRecord) {
+            std::cerr << "No puzzle of " << options.dbPath << " is rated " << options.minRating << "-"
+                      << options.maxRating << "." << std::endl;
+
+            return 1;
+      }
+
+      FILE *output = options.outputPath == nullptr ? stdout : fopen(options.outputPath, "wb");
+
+      if (output == nullptr) {
+            std::cerr << "Can't open " << options.outputPath << " for writing." << std::endl;
+
+            return 1;
+      }
+
+      auto startTime = std::chrono::steady_clock::now();
+
+      PuzzleQueue queue;
+      initPuzzleQueue(&queue, QUEUE_CAPACITY);
+
+      DistinctSet distinctSet;
+      if (options.isDistinct) initDistinctSet(&distinctSet, options.count);
+
+      std::atomic<uint64_t> nextIndex(options.firstIndex);
+      std::atomic<uint64_t> writtenIndex(options.firstIndex);
+      std::atomic<uint64_t> failedIndex(NO_FAILED_INDEX);
+      std::vector<std::thread> workers;
+
+      for (int i = 0; i < options.threadsCount; i++)
+            workers.emplace_back(generatePuzzlesInWorker, &options, options.dbPath == nullptr ? nullptr : &db,
+                                 options.isDistinct ? &distinctSet : nullptr, &nextIndex, &writtenIndex,
+                                 &failedIndex, &queue);
+
+      const bool isWritten = writeGeneratedPuzzles(&options, &queue, &writtenIndex, &failedIndex, output);
+
+      for (std::thread &worker : workers) worker.join();
+
+      freePuzzleQueue(&queue);
+
+      if (options.dbPath != nullptr) closePuzzleDb(&db);
+
+      uint64_t duplicatesCount = 0;
+
+      if (options.isDistinct) {
+            duplicatesCount = distinctSet.duplicatesCount.load();
+            freeDistinctSet(&distinctSet);
+      }
+
+      if (output != stdout) fclose(output);
+
+      if (!isWritten) {
+            std::cerr << "No puzzle " << (options.isDistinct ? "distinct from the others and " : "")
+                      << "rated " << options.minRating << "-" << options.maxRating << " came out of "
+                      << MAX_GENERATE_ATTEMPTS_COUNT << " tries at index " << failedIndex.load() << "."
+                      << std::endl;
+            finishStats(options.tracePath);
+
+            return 1;
+      }
+
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+      std::cerr << "Generated " << options.count << " puzzles in " << seconds << " s ("
+                << options.count / seconds << " puzzles/s, " << options.threadsCount << " threads, "
+                << PROPAGATION_KERNEL_NAMES[options.kernel] << " kernel, seed " << options.seed << ")";
+      if (options.isDistinct) std::cerr << ", " << duplicatesCount << " duplicates regenerated";
+      std::cerr << "." << std::endl;
+
+      return finishStats(options.tracePath) ? 0 : 1;
+}
+
+bool parseGenerateOptions(int argc, char *argv[], GenerateOptions *options) {
+      const uint64_t MAX_THREADS_COUNT = 1024;
+
+      uint64_t threadsCount = std::thread::hardware_concurrency();
+      uint64_t targetCluesCount = 0;
+      bool isRatingBand = false;
+
+      options->count = 1;
+      options->firstIndex = 0;
+      options->seed = time(nullptr);
+      options->difficulty = Difficulty::Medium;
+      options->minRating = 0;
+      options->maxRating = MAX_RATING;
+      options->isMinimal = false;
+      options->isSymmetric = false;
+      options->outputPath = nullptr;
+      options->dbPath = nullptr;
+      options->isBinary = false;
+      options->isDistinct = false;
+      options->kernel = getBestPropagationKernel();
+      options->statsMode = 0;
+      options->tracePath = nullptr;
+
+      for (int i = 1; i < argc; i++) {
+            bool hasValue = i + 1 < argc;
+            bool isParsed = true;
+
+            if (strcmp(argv[i], "--count") == 0 && hasValue)
+                  isParsed = parseUnsignedOption(argv[++i], &options->count);
+            else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+                  isParsed = parseUnsignedOption(argv[++i], &threadsCount);
+            else if (strcmp(argv[i], "--difficulty") == 0 && hasValue)
+                  isParsed = parseDifficulty(argv[++i], &options->difficulty);
+            else if (strcmp(argv[i], "--rating") == 0 && hasValue)
+                  isParsed = isRatingBand =
+                      parseRatingBand(argv[++i], &options->minRating, &options->maxRating);
+            else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+                  isParsed = parseUnsignedOption(argv[++i], &options->seed);
+            else if (strcmp(argv[i], "--db") == 0 && hasValue)
+                  options->dbPath = argv[++i];
+            else if (strcmp(argv[i], "--first") == 0 && hasValue)
+                  isParsed = parseUnsignedOption(argv[++i], &options->firstIndex);
+            else if (strcmp(argv[i], "--output") == 0 && hasValue)
+                  options->outputPath = argv[++i];
+            else if (strcmp(argv[i], "--binary") == 0)
+                  options->isBinary = true;
+            else if (strcmp(argv[i], "--distinct") == 0)
+                  options->isDistinct = true;
+            else if (strcmp(argv[i], "--minimal") == 0)
+                  options->isMinimal = true;
+            else if (strcmp(argv[i], "--clues") == 0 && hasValue)
+                  isParsed = options->isMinimal = parseUnsignedOption(argv[++i], &targetCluesCount);
+            else if (strcmp(argv[i], "--symmetric") == 0)
+                  options->isMinimal = options->isSymmetric = true;
+            else if (strcmp(argv[i], "--kernel") == 0 && hasValue)
+                  isParsed = parsePropagationKernel(argv[++i], &options->kernel);
+            else if (strcmp(argv[i], "--stats") == 0)
+                  options->statsMode |= STATS_REPORTED;
+            else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+                  options->tracePath = argv[++i];
+            else
+                  isParsed = false;
+
+            if (!isParsed) return false;
+      }
+
+      options->threadsCount = threadsCount == 0 ? 1 : threadsCount;
+      options->targetCluesCount = targetCluesCount;
+
+      if (options->tracePath != nullptr) options->statsMode |= STATS_TRACED;
+
+      if (options->dbPath != nullptr && !isRatingBand) {
+            options->minRating = DIFFICULTY_RATING_BANDS[options->difficulty][0];
+            options->maxRating = DIFFICULTY_RATING_BANDS[options->difficulty][1];
+      }
+
+      // A database may hold fewer distinct puzzles than asked for, so --distinct takes generated ones only.
+      return threadsCount <= MAX_THREADS_COUNT && targetCluesCount <= BOARD_CELLS_COUNT &&
+             !(options->dbPath != nullptr && (options->isMinimal || options->isDistinct)) &&
+             !(options->isDistinct && options->count > MAX_DISTINCT_PUZZLES_COUNT);
+}
+
+bool parseUnsignedOption(const char *text, uint64_t *value) {
+      char *end = nullptr;
+
+      *value = strtoull(text, &end, 10);
+
+      return *text != '\0' && *text != '-' && *end == '\0';
+}
+
+bool parseDifficulty(const char *text, Difficulty *difficulty) {
+      const char *NAMES[] = {"easy", "medium", "hard"};
+      const Difficulty DIFFICULTIES[] = {Difficulty::Easy, Difficulty::Medium, Difficulty::Hard};
+
+      for (int i = 0; i < 3; i++) {
+            if (strcmp(text, NAMES[i]) == 0) {
+                  *difficulty = DIFFICULTIES[i];
+
+                  return true;
+            }
+      }
+
+      return false;
+}
+
+// Band in the "MIN-MAX" form, both ends inclusive. It must hold one of the ratings the grader gives,
+// the cost of a technique or MAX_RATING, or no puzzle would ever fall in it.
+bool parseRatingBand(const char *text, int *minRating, int *maxRating) {
+      char *end = nullptr;
+
+      long minValue = strtol(text, &end, 10);
+
+      if (end == text || *end != '-') return false;
+
+      const char *maxText = end + 1;
+      long maxValue = strtol(maxText, &end, 10);
+
+      if (end == maxText || *end != '\0' || minValue > maxValue || maxValue < 0 || minValue > MAX_RATING)
+            return false;
+
+      bool isReachable = minValue <= MAX_RATING && maxValue >= MAX_RATING;
+
+      for (const int cost : TECHNIQUE_COSTS)
+            isReachable = isReachable || (cost >= minValue && cost <= maxValue);
+
+      if (!isReachable) return false;
+
+      *minRating = minValue;
+      *maxRating = maxValue;
+
+      return true;
+}
+
+// Workers claim indices in chunks from a shared cursor, so a thread which got easy puzzles simply
+// takes more chunks and all of them stay busy until the end. Every worker owns its boards and
+// seeds the generator of each puzzle from (seed, index); puzzles outside the rating band are
+// regenerated from the same stream, which keeps the result reproducible. With a database the
+// puzzles are drawn from its records of the band instead. With a distinct set, puzzles equivalent
+// to one already taken are regenerated as well. A chunk waits until it fits in the writer's reorder
+// window, so the window never overflows however far the other workers run ahead of a slow puzzle.
+// After MAX_GENERATE_ATTEMPTS_COUNT tries at one index the worker lowers failedIndex to it; workers
+// drop the indices from there on and still finish the ones before it, which the writer needs.
+void generatePuzzlesInWorker(const GenerateOptions *options, const PuzzleDb *db, DistinctSet *distinctSet,
+                             std::atomic<uint64_t> *nextIndex, const std::atomic<uint64_t> *writtenIndex,
+                             std::atomic<uint64_t> *failedIndex, PuzzleQueue *queue) {
+      const uint64_t CHUNK_SIZE = 64;
+      const uint64_t endIndex = options->firstIndex + options->count;
+      const bool isRatingBounded =
+          db == nullptr && (options->minRating > 0 || options->maxRating < MAX_RATING);
+
+      Board puzzle, solution;
+      Random random;
+      PuzzleRecord record;
+      Canonicalizer canonicalizer;
+      uint8_t canonicalDigits[BOARD_CELLS_COUNT];
+
+      for (;;) {
+            uint64_t chunkStart = nextIndex->fetch_add(CHUNK_SIZE);
+
+            if (chunkStart >= endIndex) break;
+
+            while (chunkStart + CHUNK_SIZE >
+                   writtenIndex->load(std::memory_order_acquire) + REORDER_WINDOW_SIZE) {
+                  if (chunkStart >= failedIndex->load(std::memory_order_relaxed)) return;
+
+                  std::this_thread::yield();
+            }
+
+            for (uint64_t index = chunkStart; index < endIndex && index < chunkStart + CHUNK_SIZE; index++) {
+                  seedRandom(&random, options->seed, index);
+
+                  bool isTaken;
+                  uint64_t attemptsCount = 0;
+
+                  do {
+                        if (attemptsCount++ == MAX_GENERATE_ATTEMPTS_COUNT) {
+                              uint64_t lowestFailedIndex = failedIndex->load();
+
+                              while (index < lowestFailedIndex &&
+                                     !failedIndex->compare_exchange_weak(lowestFailedIndex, index)) {
+                              }
+                        }
+
+                        if (index >= failedIndex->load(std::memory_order_relaxed)) return;
+
+                        if (db != nullptr)
+                              takeDbPuzzle(db, options->minRating, options->maxRating, &random, &puzzle,
+                                           &solution);
+                        else if (options->isMinimal)
+                              generateMinimalPuzzle(&puzzle, &solution, options->targetCluesCount,
+                                                    options->isSymmetric, &random);
+                        else
+                              generatePuzzle(&puzzle, &solution, options->difficulty, &random);
+
+                        int rating = isRatingBounded ? gradePuzzle(&puzzle).rating : options->minRating;
+
+                        isTaken = rating >= options->minRating && rating <= options->maxRating;
+
+                        if (isTaken && distinctSet != nullptr)
+                              isTaken = insertDistinctPuzzle(
+                                  distinctSet, canonicalizePuzzle(&puzzle, &canonicalizer, canonicalDigits));
+                  } while (!isTaken);
+
+                  record.index = index;
+                  memcpy(record.digits, puzzle.digits, sizeof(record.digits));
+
+                  while (!tryPushPuzzle(queue, &record)) {
+                        if (index >= failedIndex->load(std::memory_order_relaxed)) return;
+
+                        std::this_thread::yield();
+                  }
+            }
+      }
+}
+
+// Puzzles come in the order the workers finish them and wait in the reorder window until all the
+// ones before them are written, so the output is the same for any number of threads. Returns false
+// when a worker gave up on an index, after writing all the puzzles before it.
+bool writeGeneratedPuzzles(const GenerateOptions *options, PuzzleQueue *queue,
+                           std::atomic<uint64_t> *writtenIndex, const std::atomic<uint64_t> *failedIndex,
+                           FILE *output) {
+      const int BUFFER_SIZE = 1 << 16;
+      const int MAX_RECORD_SIZE = BOARD_CELLS_COUNT + 1;
+
+      static char buffer[BUFFER_SIZE];
+      int bufferedCount = 0;
+
+      std::vector<PuzzleRecord> window(REORDER_WINDOW_SIZE);
+      std::vector<bool> isWaiting(REORDER_WINDOW_SIZE);
+
+      const uint64_t endIndex = options->firstIndex + options->count;
+      uint64_t nextIndex = options->firstIndex;
+      PuzzleRecord record;
+
+      while (nextIndex < std::min(endIndex, failedIndex->load(std::memory_order_relaxed))) {
+            if (!tryPopPuzzle(queue, &record)) {
+                  std::this_thread::yield();
+                  continue;
+            }
+
+            window[record.index % REORDER_WINDOW_SIZE] = record;
+            isWaiting[record.index % REORDER_WINDOW_SIZE] = true;
+
+            for (; isWaiting[nextIndex % REORDER_WINDOW_SIZE]; nextIndex++) {
+                  isWaiting[nextIndex % REORDER_WINDOW_SIZE] = false;
+                  bufferedCount += formatPuzzleRecord(&window[nextIndex % REORDER_WINDOW_SIZE],
+                                                      options->isBinary, buffer + bufferedCount);
+
+                  if (bufferedCount > BUFFER_SIZE - MAX_RECORD_SIZE) {
+                        fwrite(buffer, 1, bufferedCount, output);
+                        bufferedCount = 0;
+                  }
+            }
+
+            writtenIndex->store(nextIndex, std::memory_order_release);
+      }
+
+      fwrite(buffer, 1, bufferedCount, output);
+      fflush(output);
+
+      return nextIndex == endIndex;
+}
+
+// Writes the record into the buffer and returns the number of bytes written.
+int formatPuzzleRecord(const PuzzleRecord *record, const bool isBinary, char *buffer) {
+      const char HIDDEN_CELL = '.';
+
+      if (isBinary) {
+            const int packedSize = (BOARD_CELLS_COUNT + 1) / 2;
+
+            memset(buffer, 0, packedSize);
+
+            for (int cell = 0; cell < BOARD_CELLS_COUNT; cell++)
+                  buffer[cell / 2] |= record->digits[cell] << (cell % 2 == 0 ? 4 : 0);
+
+            return packedSize;
+      }
+
+      for (int cell = 0; cell < BOARD_CELLS_COUNT; cell++)
+            buffer[cell] = record->digits[cell] == 0 ? HIDDEN_CELL : '0' + record->digits[cell];
+
+      buffer[BOARD_CELLS_COUNT] = '\n';
+
+      return BOARD_CELLS_COUNT + 1;
+}
+
+// Headless solving of a puzzle file: every line of 81 characters ('1'-'9' for digits, '.' or '0'
+// for hidden cells) gets a line with its solution, status and solving time. Blank lines and
+// lines starting with '#' are skipped.
+int runSolveMode(int argc, char *argv[]) {
+      SolveOptions options;
+
+      if (!parseSolveOptions(argc, argv, &options)) {
+            std::cerr << "Usage: sudoku solve [--input FILE] [--output FILE] [--threads N]\n"
+                         "                    [--solver bitmask|dlx|both] [--grade] [--hint]\n"
+                         "                    [--kernel auto|scalar|sse2|avx2] [--stats] [--trace FILE]\n"
+                         "Reads standard input without --input. 'both' solves every puzzle with both\n"
+                         "backends and reports 'mismatch' when they disagree. --grade appends the rating\n"
+                         "and the techniques a logical solution needs. --kernel picks how the bitmask\n"
+                         "solver propagates singles; auto takes the fastest one the CPU supports and the\n"
+                         "others are refused when it doesn't. --hint appends the first step of the game's\n"
+                         "hint for puzzles with a unique solution, as rRcC=D and the technique.\n"
+                         "--stats reports the solving times as a histogram on exit and --trace FILE\n"
+                         "writes them as Chrome trace JSON.\n";
+
+            return 1;
+      }
+
+      boardPropagationKernel = options.kernel;
+      enableStats(options.statsMode);
+
+      const char *data = nullptr;
+      size_t size = 0;
+      std::vector<char> stdinData;
+
+      if (!loadInput(options.inputPath, &data, &size, &stdinData)) {
+            std::cerr << "Can't read "
+                      << (options.inputPath == nullptr ? "standard input" : options.inputPath) << "."
+                      << std::endl;
+
+            return 1;
+      }
+
+      FILE *output = options.outputPath == nullptr ? stdout : fopen(options.outputPath, "wb");
+
+      if (output == nullptr) {
+            std::cerr << "Can't open " << options.outputPath << " for writing." << std::endl;
+
+            return 1;
+      }
+
+      auto startTime = std::chrono::steady_clock::now();
+
+      uint64_t statusCounts[SOLVE_STATUSES_COUNT] = {};
+      uint64_t tasksCount = 0;
+      double solvingMicroseconds = 0;
+
+      std::vector<SolveTask> tasks;
+      std::vector<char> outputBuffer;
+
+      for (size_t offset = 0; offset < size;) {
+            offset = collectSolveTasks(data, size, offset, &tasks);
+
+            solveTaskBatch(&options, &tasks);
+
+            outputBuffer.clear();
+
+            for (const SolveTask &task : tasks) {
+                  appendSolveTask(&task, &outputBuffer);
+
+                  statusCounts[task.status]++;
+                  solvingMicroseconds += task.microseconds;
+            }
+
+            fwrite(outputBuffer.data(), 1, outputBuffer.size(), output);
+            tasksCount += tasks.size();
+      }
+
+      fflush(output);
+
+      if (output != stdout) fclose(output);
+      if (options.inputPath != nullptr && size != 0) munmap((void *)data, size);
+
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+      std::cerr << "Solved " << tasksCount << " puzzles in " << seconds << " s (" << tasksCount / seconds
+                << " puzzles/s, " << options.threadsCount << " threads, "
+                << PROPAGATION_KERNEL_NAMES[options.kernel] << " kernel, mean solving time "
+                << (tasksCount == 0 ? 0 : solvingMicroseconds / tasksCount) << " us):";
+      for (int i = 0; i < SOLVE_STATUSES_COUNT; i++)
+            std::cerr << " " << SOLVE_STATUS_NAMES[i] << " " << statusCounts[i];
+      std::cerr << "." << std::endl;
+
+      if (!finishStats(options.tracePath)) return 1;
+
+      return statusCounts[SolveStatus::Mismatch] == 0 ? 0 : 2;
+}
+
+bool parseSolveOptions(int argc, char *argv[], SolveOptions *options) {
+      const uint64_t MAX_THREADS_COUNT = 1024;
+
+      uint64_t threadsCount = std::thread::hardware_concurrency();
+
+      options->inputPath = nullptr;
+      options->outputPath = nullptr;
+      options->backend = SolverBackend::Bitmask;
+      options->isCrossChecked = false;
+      options->isGraded = false;
+      options->isHinted = false;
+      options->kernel = getBestPropagationKernel();
+      options->statsMode = 0;
+      options->tracePath = nullptr;
+
+      for (int i = 1; i < argc; i++) {
+            bool hasValue = i + 1 < argc;
+            bool isParsed = true;
+
+            if (strcmp(argv[i], "--input") == 0 && hasValue) {
+                  options->inputPath = argv[++i];
+            } else if (strcmp(argv[i], "--output") == 0 && hasValue) {
+                  options->outputPath = argv[++i];
+            } else if (strcmp(argv[i], "--threads") == 0 && hasValue) {
+                  isParsed = parseUnsignedOption(argv[++i], &threadsCount);
+            } else if (strcmp(argv[i], "--solver") == 0 && hasValue) {
+                  const char *name = argv[++i];
+
+                  bool isDlx = strcmp(name, "dlx") == 0;
+
+                  options->backend = isDlx ? SolverBackend::DancingLinks : SolverBackend::Bitmask;
+                  options->isCrossChecked = strcmp(name, "both") == 0;
+
+                  isParsed = isDlx || options->isCrossChecked || strcmp(name, "bitmask") == 0;
+            } else if (strcmp(argv[i], "--grade") == 0) {
+                  options->isGraded = true;
+            } else if (strcmp(argv[i], "--hint") == 0) {
+                  options->isHinted = true;
+            } else if (strcmp(argv[i], "--kernel") == 0 && hasValue) {
+                  isParsed = parsePropagationKernel(argv[++i], &options->kernel);
+            } else if (strcmp(argv[i], "--stats") == 0) {
+                  options->statsMode |= STATS_REPORTED;
+            } else if (strcmp(argv[i], "--trace") == 0 && hasValue) {
+                  options->statsMode |= STATS_TRACED;
+                  options->tracePath = argv[++i];
+            } else {
+                  isParsed = false;
+            }
+
+            if (!isParsed) return false;
+      }
+
+      options->threadsCount = threadsCount == 0 ? 1 : threadsCount;
+
+      return threadsCount <= MAX_THREADS_COUNT;
+}
+
+// Maps the file, or reads standard input without a path.
+bool loadInput(const char *path, const char **data, size_t *size, std::vector<char> *stdinData) {
+      if (path != nullptr) return mapInputFile(path, data, size);
+
+      bool isRead = readWholeStream(STDIN_FILENO, stdinData);
+
+      *data = stdinData->data();
+      *size = stdinData->size();
+
+      return isRead;
+}
+
+// Maps the whole file read-only. An empty file gives an empty range.
+bool mapInputFile(const char *path, const char **data, size_t *size) {
+      int fd = open(path, O_RDONLY);
+
+      if (fd == -1) return false;
+
+      struct stat fileStat;
+      bool isMapped = fstat(fd, &fileStat) == 0;
+
+      *size = isMapped ? fileStat.st_size : 0;
+      *data = nullptr;
+
+      if (isMapped && *size != 0) {
+            void *mapping = mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            isMapped = mapping != MAP_FAILED;
+
+            if (isMapped) {
+                  madvise(mapping, *size, MADV_SEQUENTIAL);
+                  *data = (const char *)mapping;
+            }
+      }
+
+      close(fd);
+
+      return isMapped;
+}
+
+// Reads pipes and other unmappable inputs in large chunks.
+bool readWholeStream(int fd, std::vector<char> *data) {
+      const size_t CHUNK_SIZE = 1 << 20;
+
+      for (;;) {
+            size_t size = data->size();
+            data->resize(size + CHUNK_SIZE);
+
+            ssize_t readCount = read(fd, data->data() + size, CHUNK_SIZE);
+
+            data->resize(size + (readCount > 0 ? readCount : 0));
+
+            if (readCount <= 0) return readCount == 0;
+      }
+}
+
+// Fills the tasks with the next batch of puzzle lines starting at the offset and returns the offset
+// right after the batch.
+size_t collectSolveTasks(const char *data, const size_t size, size_t offset, std::vector<SolveTask> *tasks) {
+      const size_t BATCH_SIZE = 1 << 16;
+
+      tasks->clear();
+
+      while (offset < size && tasks->size() < BATCH_SIZE) {
+            const char *line = data + offset;
+            const char *lineEnd = (const char *)memchr(line, '\n', size - offset);
+            size_t length = lineEnd == nullptr ? size - offset : lineEnd - line;
+
+            offset += length + 1;
+
+            while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == ' ')) length--;
+
+            if (length == 0 || line[0] == '#') continue;
+
+            SolveTask task;
+            task.line = line;
+            task.lineLength = length;
+            task.grade = Grade{0, 0, 0, false};
+            task.hint.cell = -1;
+
+            tasks->push_back(task);
+      }
+
+      return offset;
+}
+
+// Solves the batch on options->threadsCount threads.
+void solveTaskBatch(const SolveOptions *options, std::vector<SolveTask> *tasks) {
+      std::atomic<size_t> nextTask(0);
+      std::vector<std::thread> workers;
+
+      for (int i = 0; i < options->threadsCount; i++)
+            workers.emplace_back(solvePuzzlesInWorker, options, tasks, &nextTask);
+
+      for (std::thread &worker : workers) worker.join();
+}
+
+void solvePuzzlesInWorker(const SolveOptions *options, std::vector<SolveTask> *tasks,
+                          std::atomic<size_t> *nextTask) {
+      const size_t CHUNK_SIZE = 256;
+
+      for (;;) {
+            size_t chunkStart = nextTask->fetch_add(CHUNK_SIZE);
+
+            if (chunkStart >= tasks->size()) break;
+
+            for (size_t i = chunkStart; i < tasks->size() && i < chunkStart + CHUNK_SIZE; i++)
+                  solveTask(options, &(*tasks)[i]);
+      }
+}
+
+void solveTask(const SolveOptions *options, SolveTask *task) {
+      Board puzzle, solution;
+
+      const uint64_t startNs = startStatTimer();
+      auto startTime = std::chrono::steady_clock::now();
+
+      if (!parsePuzzleLine(task->line, task->lineLength, &puzzle)) {
+            task->status = SolveStatus::Invalid;
+      } else {
+            int solutionsCount = findSolutions(&puzzle, 2, &solution, options->backend);
+
+            bool isMismatch = options->isCrossChecked &&
+                              countSolutions(&puzzle, 2, SolverBackend::DancingLinks) != solutionsCount;
+
+            if (isMismatch)
+                  task->status = SolveStatus::Mismatch;
+            else if (solutionsCount == 0)
+                  task->status = SolveStatus::Unsolvable;
+            else
+                  task->status = solutionsCount == 1 ? SolveStatus::Unique : SolveStatus::Multiple;
+
+            if (solutionsCount != 0) memcpy(task->solution, solution.digits, sizeof(task->solution));
+
+            if (options->isGraded && task->status == SolveStatus::Unique) task->grade = gradePuzzle(&puzzle);
+            if (options->isHinted && task->status == SolveStatus::Unique)
+                  findHint(&puzzle, &solution, &task->hint);
+      }
+
+      auto elapsed = std::chrono::steady_clock::now() - startTime;
+
+      task->microseconds = std::chrono::duration<float, std::micro>(elapsed).count();
+
+      stopStatTimer(StatHistogram::SolveTime, startNs);
+}
+
+bool parsePuzzleLine(const char *line, const int length, Board *puzzle) {
+      if (length != BOARD_CELLS_COUNT) return false;
+
+      *puzzle = Board{};
+
+      for (int cell = 0; cell < BOARD_CELLS_COUNT; cell++) {
+            const char symbol = line[cell];
+
+            if (symbol >= '1' && symbol <= '9')
+                  setDigit(puzzle, cell, symbol - '0');
+            else if (symbol != '.' && symbol != '0')
+                  return false;
+      }
+
+      return true;
+}
+
+// Output line: the solution (or the input line when there is none), the status and the solving
+// time in microseconds, separated by spaces. Graded puzzles add the rating and the comma-separated
+// techniques, hinted ones the first step of the hint.
+void appendSolveTask(const SolveTask *task, std::vector<char> *output) {
+      char stats[64];
+      bool hasSolution = task->status == SolveStatus::Unique || task->status == SolveStatus::Multiple;
+
+      if (hasSolution) {
+            for (uint8_t digit : task->solution) output->push_back('0' + digit);
+      } else {
+            output->insert(output->end(), task->line, task->line + task->lineLength);
+      }
+
+      int statsLength =
+          snprintf(stats, sizeof(stats), " %s %.1f", SOLVE_STATUS_NAMES[task->status], task->microseconds);
+      output->insert(output->end(), stats, stats + statsLength);
+
+      if (task->grade.stepsCount != 0) {
+            statsLength = snprintf(stats, sizeof(stats), " %d ", task->grade.rating);
+            output->insert(output->end(), stats, stats + statsLength);
+
+            for (int technique = 0; technique < TECHNIQUES_COUNT; technique++) {
+                  if ((task->grade.usedTechniques & (1 << technique)) == 0) continue;
+
+                  const char *name = TECHNIQUE_NAMES[technique];
+
+                  if (output->back() != ' ') output->push_back(',');
+                  output->insert(output->end(), name, name + strlen(name));
+            }
+      }
+
+      if (task->hint.cell != -1) {
+            const int row = task->hint.cell / BOARD_DIMENSION + 1;
+            const int col = task->hint.cell % BOARD_DIMENSION + 1;
+
+            statsLength = snprintf(stats, sizeof(stats), " r%dc%d=%d %s", row, col, task->hint.digit,
+                                   getHintStepName(task->hint.technique));
+            output->insert(output->end(), stats, stats + statsLength);
+      }
+
+      output->push_back('\n');
+}
+
+// Packs a file of 81-char puzzle lines into a database. The solve mode's workers solve and grade
+// the puzzles, and those without a unique solution are skipped. Records go to a temporary file in
+// input order, with a byte per puzzle for its rating kept in memory. They are then sorted into
+// their rating groups through a buffer per group, so inputs of many gigabytes need little memory.
+int runPackMode(int argc, char *argv[]) {
+      const size_t GROUP_BUFFER_SIZE = 1024;
+
+      PackOptions options;
+
+      if (!parsePackOptions(argc, argv, &options)) {
+            std::cerr << "Usage: sudoku pack --output FILE [--input FILE] [--threads N]\n"
+                         "Reads standard input without --input: lines of 81 chars, '1'-'9' for digits and\n"
+                         "'.' or '0' for hidden cells. Puzzles without a unique solution are skipped.\n";
+
+            return 1;
+      }
+
+      const char *data = nullptr;
+      size_t size = 0;
+      std::vector<char> stdinData;
+
+      if (!loadInput(options.inputPath, &data, &size, &stdinData)) {
+            std::cerr << "Can't read "
+                      << (options.inputPath == nullptr ? "standard input" : options.inputPath) << "."
+                      << std::endl;
+
+            return 1;
+      }
+
+      char unsortedPath[PATH_MAX];
+      snprintf(unsortedPath, sizeof(unsortedPath), "%s.unsorted", options.outputPath);
+
+      FILE *unsorted = fopen(unsortedPath, "w+b");
+      int outputFd = unsorted == nullptr ? -1 : open(options.outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+      if (outputFd == -1) {
+            if (unsorted != nullptr) {
+                  fclose(unsorted);
+                  unlink(unsortedPath);
+            }
+
+            std::cerr << "Can't open " << options.outputPath << " for writing." << std::endl;
+
+            return 1;
+      }
+
+      auto startTime = std::chrono::steady_clock::now();
+
+      SolveOptions solveOptions{};
+      solveOptions.threadsCount = options.threadsCount;
+      solveOptions.backend = SolverBackend::Bitmask;
+      solveOptions.isGraded = true;
+
+      uint64_t ratingCounts[MAX_RATING + 1] = {};
+      uint64_t skippedCount = 0;
+
+      std::vector<uint8_t> ratings;
+      std::vector<SolveTask> tasks;
+
+      Board puzzle;
+      PuzzleDbRecord record;
+      bool isWritten = true;
+
+      for (size_t offset = 0; isWritten && offset < size;) {
+            offset = collectSolveTasks(data, size, offset, &tasks);
+
+            solveTaskBatch(&solveOptions, &tasks);
+
+            for (const SolveTask &task : tasks) {
+                  if (task.status != SolveStatus::Unique) {
+                        skippedCount++;
+
+                        continue;
+                  }
+
+                  parsePuzzleLine(task.line, task.lineLength, &puzzle);
+                  packDbRecord(&puzzle, task.solution, &record);
+
+                  if (fwrite(&record, sizeof(record), 1, unsorted) != 1) {
+                        isWritten = false;
+
+                        break;
+                  }
+
+                  ratings.push_back(task.grade.rating);
+                  ratingCounts[task.grade.rating]++;
+            }
+      }
+
+      if (options.inputPath != nullptr && size != 0) munmap((void *)data, size);
+
+      PuzzleDbHeader header{};
+      memcpy(header.magic, PUZZLE_DB_MAGIC, sizeof(header.magic));
+      header.version = PUZZLE_DB_VERSION;
+      header.recordSize = sizeof(PuzzleDbRecord);
+      header.recordsCount = ratings.size();
+
+      for (int rating = 0; rating <= MAX_RATING; rating++)
+            header.ratingStarts[rating + 1] = header.ratingStarts[rating] + ratingCounts[rating];
+
+      isWritten = isWritten && fflush(unsorted) == 0 && ferror(unsorted) == 0 &&
+                  pwrite(outputFd, &header, sizeof(header), 0) == sizeof(header);
+
+      const char *unsortedData = nullptr;
+      size_t unsortedSize = 0;
+
+      // A short temporary file would have the loop below read past the end of the mapping.
+      isWritten = isWritten && mapInputFile(unsortedPath, &unsortedData, &unsortedSize) &&
+                  unsortedSize == ratings.size() * sizeof(PuzzleDbRecord);
+
+      const PuzzleDbRecord *unsortedRecords = (const PuzzleDbRecord *)unsortedData;
+      std::vector<PuzzleDbRecord> groups[MAX_RATING + 1];
+      uint64_t nextRecords[MAX_RATING + 1];
+
+      for (int rating = 0; rating <= MAX_RATING; rating++) nextRecords[rating] = header.ratingStarts[rating];
+
+      for (size_t i = 0; isWritten && i < ratings.size(); i++) {
+            std::vector<PuzzleDbRecord> *group = &groups[ratings[i]];
+
+            group->push_back(unsortedRecords[i]);
+
+            if (group->size() == GROUP_BUFFER_SIZE)
+                  isWritten = writeRecordGroup(outputFd, group, &nextRecords[ratings[i]]);
+      }
+
+      for (int rating = 0; isWritten && rating <= MAX_RATING; rating++)
+            isWritten = writeRecordGroup(outputFd, &groups[rating], &nextRecords[rating]);
+
+      if (unsortedData != nullptr) munmap((void *)unsortedData, unsortedSize);
+
+      fclose(unsorted);
+      unlink(unsortedPath);
+      isWritten = close(outputFd) == 0 && isWritten;
+
+      if (!isWritten) {
+            unlink(options.outputPath);
+
+            std::cerr << "Can't write " << options.outputPath << "." << std::endl;
+
+            return 1;
+      }
+
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+      std::cerr << "Packed " << ratings.size() << " puzzles into " << options.outputPath << " in " << seconds
+                << " s (" << skippedCount << " skipped without a unique solution), by rating:";
+      for (int rating = 0; rating <= MAX_RATING; rating++)
+            if (ratingCounts[rating] != 0) std::cerr << " " << rating << " " << ratingCounts[rating];
+      std::cerr << "." << std::endl;
+
+      return 0;
+}
+
+bool parsePackOptions(int argc, char *argv[], PackOptions *options) {
+      const uint64_t MAX_THREADS_COUNT = 1024;
+
+      uint64_t threadsCount = std::thread::hardware_concurrency();
+
+      options->inputPath = nullptr;
+      options->outputPath = nullptr;
+
+      for (int i = 1; i < argc; i++) {
+            bool hasValue = i + 1 < argc;
+            bool isParsed = true;
+
+            if (strcmp(argv[i], "--input") == 0 && hasValue)
+                  options->inputPath = argv[++i];
+            else if (strcmp(argv[i], "--output") == 0 && hasValue)
+                  options->outputPath = argv[++i];
+            else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+                  isParsed = parseUnsignedOption(argv[++i], &threadsCount);
+            else
+                  isParsed = false;
+
+            if (!isParsed) return false;
+      }
+
+      options->threadsCount = threadsCount == 0 ? 1 : threadsCount;
+
+      return options->outputPath != nullptr && threadsCount <= MAX_THREADS_COUNT;
+}
+
+// Writes the buffered records of a rating group at the next place of the group and empties the
+// buffer.
+bool writeRecordGroup(int fd, std::vector<PuzzleDbRecord> *group, uint64_t *nextRecord) {
+      const char *data = (const char *)group->data();
+      size_t size = group->size() * sizeof(PuzzleDbRecord);
+      off_t offset = sizeof(PuzzleDbHeader) + *nextRecord * sizeof(PuzzleDbRecord);
+
+      while (size != 0) {
+            ssize_t writtenCount = pwrite(fd, data, size, offset);
+
+            if (writtenCount == -1 && errno == EINTR) continue;
+            if (writtenCount <= 0) return false;
+
+            data += writtenCount;
+            size -= writtenCount;
+            offset += writtenCount;
+      }
+
+      *nextRecord += group->size();
+      group->clear();
+
+      return true;
+}
+
+// Writes the puzzles of a database back as 81-char lines, in the order of their ratings.
+int runUnpackMode(int argc, char *argv[]) {
+      const int BUFFER_SIZE = 1 << 16;
+      const int LINE_SIZE = BOARD_CELLS_COUNT + 1;
+
+      UnpackOptions options;
+
+      if (!parseUnpackOptions(argc, argv, &options)) {
+            std::cerr << "Usage: sudoku unpack --input FILE [--output FILE] [--rating MIN-MAX]\n"
+                         "--rating keeps only the puzzles whose grade falls in the band.\n";
+
+            return 1;
+      }
+
+      PuzzleDb db;
+
+      if (!openPuzzleDb(options.inputPath, &db)) {
+            std::cerr << "Can't read " << options.inputPath << " as a puzzle database." << std::endl;
+
+            return 1;
+      }
+
+      FILE *output = options.outputPath == nullptr ? stdout : fopen(options.outputPath, "wb");
+
+      if (output == nullptr) {
+            std::cerr << "Can't open " << options.outputPath << " for writing." << std::endl;
+
+            return 1;
+      }
+
+      madvise((void *)db.data, db.size, MADV_SEQUENTIAL);
+
+      uint64_t first, end;
+      getDbRatingRange(&db, options.minRating, options.maxRating, &first, &end);
+
+      static char buffer[BUFFER_SIZE];
+      int bufferedCount = 0;
+
+      PuzzleRecord record;
+      uint8_t solutionDigits[BOARD_CELLS_COUNT];
+
+      for (uint64_t i = first; i < end; i++) {
+            unpackDbRecord(&db.records[i], record.digits, solutionDigits);
+
+            bufferedCount += formatPuzzleRecord(&record, false, buffer + bufferedCount);
+
+            if (bufferedCount > BUFFER_SIZE - LINE_SIZE) {
+                  fwrite(buffer, 1, bufferedCount, output);
+                  bufferedCount = 0;
+            }
+      }
+
+      fwrite(buffer, 1, bufferedCount, output);
+      fflush(output);
+
+      if (output != stdout) fclose(output);
+
+      closePuzzleDb(&db);
+
+      std::cerr << "Unpacked " << end - first << " puzzles." << std::endl;
+
+      return 0;
+}
+
+bool parseUnpackOptions(int argc, char *argv[], UnpackOptions *options) {
+      options->inputPath = nullptr;
+      options->outputPath = nullptr;
+      options->minRating = 0;
+      options->maxRating = MAX_RATING;
+
+      for (int i = 1; i < argc; i++) {
+            bool hasValue = i + 1 < argc;
+            bool isParsed = true;
+
+            if (strcmp(argv[i], "--input") == 0 && hasValue)
+                  options->inputPath = argv[++i];
+            else if (strcmp(argv[i], "--output") == 0 && hasValue)
+                  options->outputPath = argv[++i];
+            else if (strcmp(argv[i], "--rating") == 0 && hasValue)
+                  isParsed = parseRatingBand(argv[++i], &options->minRating, &options->maxRating);
+            else
+                  isParsed = false;
+
+            if (!isParsed) return false;
+      }
+
+      return options->inputPath != nullptr;
+}
+
+// Maps the database and checks that its header and index fit the file; the puzzles are read only
+// when taken.
+bool openPuzzleDb(const char *path, PuzzleDb *db) {
+      if (!mapInputFile(path, &db->data, &db->size)) return false;
+
+      const PuzzleDbHeader *header = (const PuzzleDbHeader *)db->data;
+
+      bool isValid = db->size >= sizeof(PuzzleDbHeader) &&
+                     memcmp(header->magic, PUZZLE_DB_MAGIC, sizeof(PUZZLE_DB_MAGIC)) == 0 &&
+                     header->version == PUZZLE_DB_VERSION && header->recordSize == sizeof(PuzzleDbRecord) &&
+                     header->recordsCount <= (db->size - sizeof(PuzzleDbHeader)) / sizeof(PuzzleDbRecord) &&
+                     header->ratingStarts[0] == 0 &&
+                     header->ratingStarts[MAX_RATING + 1] == header->recordsCount;
+
+      for (int rating = 0; isValid && rating <= MAX_RATING; rating++)
+            isValid = header->ratingStarts[rating] <= header->ratingStarts[rating + 1];
+
+      if (!isValid) {
+            if (db->size != 0) munmap((void *)db->data, db->size);
+
+            return false;
+      }
+
+      madvise((void *)db->data, db->size, MADV_RANDOM);
+
+      db->header = header;
+      db->records = (const PuzzleDbRecord *)(db->data + sizeof(PuzzleDbHeader));
+
+      return true;
+}
+
+void closePuzzleDb(PuzzleDb *db) { munmap((void *)db->data, db->size); }
+
+// Records [first, end) of the database are the ones rated within the band.
+void getDbRatingRange(const PuzzleDb *db, const int minRating, const int maxRating, uint64_t *first,
+                      uint64_t *end) {
+      *first = db->header->ratingStarts[std::clamp(minRating, 0, MAX_RATING)];
+      *end = db->header->ratingStarts[std::clamp(maxRating, 0, MAX_RATING) + 1];
+}
+
+// Picks a random puzzle rated within the band, in constant time whatever the size of the database.
+// Returns false when the band is empty.
+bool takeDbPuzzle(const PuzzleDb *db, const int minRating, const int maxRating, Random *random, Board *puzzle,
+                  Board *solution) {
+      uint64_t first, end;
+      getDbRatingRange(db, minRating, maxRating, &first, &end);
+
+      if (first >= end) return false;
+
+      uint8_t puzzleDigits[BOARD_CELLS_COUNT], solutionDigits[BOARD_CELLS_COUNT];
+      unpackDbRecord(&db->records[first + getRandomIndex(random, end - first)], puzzleDigits, solutionDigits);
+
+      *puzzle = Board{};
+      *solution = Board{};
+
+      for (int cell = 0; cell < BOARD_CELLS_COUNT; cell++) {
+            setDigit(puzzle, cell, puzzleDigits[cell]);
+            setDigit(solution, cell, solutionDigits[cell]);
+      }
+
+      return true;
+}
+
+void packDbRecord(const Board *puzzle, const uint8_t *solutionDigits, PuzzleDbRecord *record) {
+      *record = PuzzleDbRecord{};
+
+      for (int cell = 0; cell < BOARD_CELLS_COUNT; cell++) {
+            record->solution[cell / 2] |= solutionDigits[cell] << (cell % 2 == 0 ? 4 : 0);
+
+            if (puzzle->digits[cell] != 0) record->givens[cell / 8] |= 1 << (cell % 8);
+      }
+}
+
+void unpackDbRecord(const PuzzleDbRecord *record, uint8_t *puzzleDigits, uint8_t *solutionDigits) {
+      for (int cell = 0; cell < BOARD_CELLS_COUNT; cell++) {
+            solutionDigits[cell] = (record->solution[cell / 2] >> (cell % 2 == 0 ? 4 : 0)) & 0xF;
+            puzzleDigits[cell] = (record->givens[cell / 8] >> (cell % 8)) & 1 ? solutionDigits[cell] : 0;
+      }
+}
+
+void initPuzzleQueue(PuzzleQueue *queue, const uint64_t capacity) {
+      queue->slots = new PuzzleQueueSlot[capacity];
+      queue->mask = capacity - 1;
+
+      for (uint64_t i = 0; i < capacity; i++) queue->slots[i].sequence.store(i, std::memory_order_relaxed);
+
+      queue->tail.store(0, std::memory_order_relaxed);
+      queue->head.store(0, std::memory_order_relaxed);
+}
+
+void freePuzzleQueue(PuzzleQueue *queue) { delete[] queue->slots; }
+
+// Returns false when the queue is full.
+bool tryPushPuzzle(PuzzleQueue *queue, const PuzzleRecord *record) {
+      uint64_t position = queue->tail.load(std::memory_order_relaxed);
+
+      for (;;) {
+            PuzzleQueueSlot *slot = &queue->slots[position & queue->mask];
+            int64_t difference = (int64_t)slot->sequence.load(std::memory_order_acquire) - (int64_t)position;
+
+            if (difference == 0) {
+                  if (queue->tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        slot->record = *record;
+                        slot->sequence.store(position + 1, std::memory_order_release);
+
+                        return true;
+                  }
+            } else if (difference < 0) {
+                  return false;
+            } else {
+                  position = queue->tail.load(std::memory_order_relaxed);
+            }
+      }
+}
+
+// Returns false when the queue is empty.
+bool tryPopPuzzle(PuzzleQueue *queue, PuzzleRecord *record) {
+      uint64_t position = queue->head.load(std::memory_order_relaxed);
+
+      for (;;) {
+            PuzzleQueueSlot *slot = &queue->slots[position & queue->mask];
+            int64_t difference =
+                (int64_t)slot->sequence.load(std::memory_order_acquire) - (int64_t)(position + 1);
+
+            if (difference == 0) {
+                  if (queue->head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        *record = slot->record;
+                        slot->sequence.store(position + queue->mask + 1, std::memory_order_release);
+
+                        return true;
+                  }
+            } else if (difference < 0) {
+                  return false;
+            } else {
+                  position = queue->head.load(std::memory_order_relaxed);
+            }
+      }
+}
@@ -0,0 +1,422 @@
+// sudoku_bench.cpp - microbenchmarks of the engine, reported as JSON with percentiles
+#include "sudoku.h"
+
+#include <sys/mman.h>
+
+#ifndef SUDOKU_BENCH_CORPUS
+#define SUDOKU_BENCH_CORPUS "bench/corpus.txt"
+#endif
+
+// Iteration i of every benchmark draws from stream i of this seed and puzzle i of the corpus, so two
+// runs do the same work and their checksums match.
+const uint64_t BENCH_SEED = 2026;
+const uint64_t WARMUP_ITERATIONS_COUNT = 16;
+
+struct BenchOptions {
+      uint64_t iterationsCount;  // 0 keeps the default of every benchmark
+      const char *filter;
+      const char *corpusPath;
+      const char *outputPath;
+      PropagationKernel kernel;
+};
+
+// Inputs of the benchmarks, built once before any of them runs. field, defaultField and progress
+// are the game's state for validation and drawing, changed by the iterations as the player would.
+struct BenchState {
+      std::vector<Board> puzzles, solutions;
+      Board field, defaultField;
+      Progress<BOARD_SECTION_LEN> progress;
+      Screen screen;
+      Random random;
+      uint64_t checksum;  // results of the iterations, so none of the work can be optimized away
+};
+
+typedef void (*BenchFunction)(BenchState *state, const uint64_t iteration);
+
+struct Benchmark {
+      const char *name;
+      BenchFunction run;
+      uint64_t iterationsCount;
+};
+
+// Nanoseconds per iteration.
+struct BenchResult {
+      const char *name;
+      uint64_t iterationsCount;
+      uint64_t min, p50, p90, p99, max;
+      double mean;
+      uint64_t checksum;
+};
+
+bool parseBenchOptions(int argc, char *argv[], BenchOptions *options);
+bool loadCorpus(const char *path, BenchState *state);
+void runBenchmark(const Benchmark *benchmark, const uint64_t iterationsCount, BenchState *state,
+                  BenchResult *result);
+uint64_t getPercentile(const std::vector<uint64_t> *sortedSamples, const int percent);
+void appendBenchReport(const BenchOptions *options, const BenchState *state,
+                       const std::vector<BenchResult> *results, std::vector<char> *output);
+
+void benchFillRowMajor(BenchState *state, const uint64_t iteration);
+void benchFillMostConstrained(BenchState *state, const uint64_t iteration);
+void benchFill16MostConstrained(BenchState *state, const uint64_t iteration);
+void benchFill25MostConstrained(BenchState *state, const uint64_t iteration);
+void benchHideEasy(BenchState *state, const uint64_t iteration);
+void benchHideMedium(BenchState *state, const uint64_t iteration);
+void benchHideHard(BenchState *state, const uint64_t iteration);
+void benchHideMinimal(BenchState *state, const uint64_t iteration);
+void benchEnterDigit(BenchState *state, const uint64_t iteration);
+void benchCheckField(BenchState *state, const uint64_t iteration);
+void benchSolveBitmask(BenchState *state, const uint64_t iteration);
+void benchSolveDlx(BenchState *state, const uint64_t iteration);
+void benchGrade(BenchState *state, const uint64_t iteration);
+void benchHint(BenchState *state, const uint64_t iteration);
+void benchDrawField(BenchState *state, const uint64_t iteration);
+
+const Benchmark BENCHMARKS[] = {
+      {"fill/row-major/9x9", benchFillRowMajor, 10000},
+      {"fill/most-constrained/9x9", benchFillMostConstrained, 10000},
+      {"fill/most-constrained/16x16", benchFill16MostConstrained, 1000},
+      {"fill/most-constrained/25x25", benchFill25MostConstrained, 200},
+      {"hide/easy", benchHideEasy, 2000},
+      {"hide/medium", benchHideMedium, 2000},
+      {"hide/hard", benchHideHard, 2000},
+      {"hide/minimal", benchHideMinimal, 1000},
+      {"validate/enter-digit", benchEnterDigit, 100000},
+      {"validate/check-field", benchCheckField, 100000},
+      {"solve/bitmask", benchSolveBitmask, 10000},
+      {"solve/dlx", benchSolveDlx, 10000},
+      {"solve/grade", benchGrade, 10000},
+      {"solve/hint", benchHint, 10000},
+      {"draw/field", benchDrawField, 10000},
+};
+
+int main(int argc, char *argv[]) {
+      BenchOptions options;
+
+      if (!parseBenchOptions(argc, argv, &options)) {
+            std::cerr << "Usage: sudoku_bench [--iterations N] [--filter TEXT] [--corpus FILE]\n"
+                         "                    [--output FILE] [--kernel auto|scalar|sse2|avx2]\n"
+                         "Runs the benchmarks whose name contains --filter, every one for its own number\n"
+                         "of iterations unless --iterations sets it, and writes their nanoseconds per\n"
+                         "iteration as JSON: min, p50, p90, p99, max and mean. The solving ones take the\n"
+                         "puzzles of the corpus in turn. Runs with the same options do the same work and\n"
+                         "report the same checksums.\n";
+
+            return 1;
+      }
+
+      boardPropagationKernel = options.kernel;
+
+      BenchState state{};
+
+      if (!loadCorpus(options.corpusPath, &state)) {
+            std::cerr << "Can't read " << options.corpusPath << " as a corpus of 9x9 puzzles." << std::endl;
+
+            return 1;
+      }
+
+      FILE *output = options.outputPath == nullptr ? stdout : fopen(options.outputPath, "wb");
+
+      if (output == nullptr) {
+            std::cerr << "Can't open " << options.outputPath << " for writing." << std::endl;
+
+            return 1;
+      }
+
+      std::vector<BenchResult> results;
+
+      for (const Benchmark &benchmark : BENCHMARKS) {
+            if (options.filter != nullptr && strstr(benchmark.name, options.filter) == nullptr) continue;
+
+            BenchResult result;
+            runBenchmark(&benchmark, options.iterationsCount == 0 ? benchmark.iterationsCount
+                                                                  : options.iterationsCount,
+                         &state, &result);
+            results.push_back(result);
+
+            std::cerr << result.name << ": p50 " << result.p50 << " ns, p99 " << result.p99 << " ns"
+                      << std::endl;
+      }
+
+      std::vector<char> report;
+      appendBenchReport(&options, &state, &results, &report);
+
+      fwrite(report.data(), 1, report.size(), output);
+
+      if (output != stdout) fclose(output);
+
+      return 0;
+}
+
+bool parseBenchOptions(int argc, char *argv[], BenchOptions *options) {
+      options->iterationsCount = 0;
+      options->filter = nullptr;
+      options->corpusPath = SUDOKU_BENCH_CORPUS;
+      options->outputPath = nullptr;
+      options->kernel = getBestPropagationKernel();
+
+      for (int i = 1; i < argc; i++) {
+            bool hasValue = i + 1 < argc;
+            bool isParsed = true;
+
+            if (strcmp(argv[i], "--iterations") == 0 && hasValue) {
+                  isParsed = parseUnsignedOption(argv[++i], &options->iterationsCount) &&
+                             options->iterationsCount > 0;
+            } else if (strcmp(argv[i], "--filter") == 0 && hasValue) {
+                  options->filter = argv[++i];
+            } else if (strcmp(argv[i], "--corpus") == 0 && hasValue) {
+                  options->corpusPath = argv[++i];
+            } else if (strcmp(argv[i], "--output") == 0 && hasValue) {
+                  options->outputPath = argv[++i];
+            } else if (strcmp(argv[i], "--kernel") == 0 && hasValue) {
+                  isParsed = parsePropagationKernel(argv[++i], &options->kernel);
+            } else {
+                  isParsed = false;
+            }
+
+            if (!isParsed) return false;
+      }
+
+      return true;
+}
+
+// Keeps the puzzles of the corpus with a unique solution, and sets up the game's state from the
+// first one. An empty corpus is refused, since the solving benchmarks need a puzzle per iteration.
+bool loadCorpus(const char *path, BenchState *state) {
+      const int MIDDLE = BOARD_DIMENSION / 2;
+
+      const char *data = nullptr;
+      size_t size = 0;
+      std::vector<char> stdinData;
+
+      if (!loadInput(path, &data, &size, &stdinData)) return false;
+
+      std::vector<SolveTask> tasks;
+
+      for (size_t offset = 0; offset < size;) {
+            offset = collectSolveTasks(data, size, offset, &tasks);
+
+            for (const SolveTask &task : tasks) {
+                  Board puzzle, solution;
+
+                  if (!parsePuzzleLine(task.line, task.lineLength, &puzzle)) continue;
+                  if (findSolutions(&puzzle, 2, &solution, SolverBackend::Bitmask) != 1) continue;
+
+                  state->puzzles.push_back(puzzle);
+                  state->solutions.push_back(solution);
+            }
+      }
+
+      if (size != 0) munmap((void *)data, size);
+
+      if (state->puzzles.empty()) return false;
+
+      state->defaultField = state->field = state->puzzles[0];
+      resetProgress(&state->progress, &state->field, &state->defaultField);
+
+      // The first frame is drawn from a cleared screen; the measured ones only send what changed.
+      clearScreen(&state->screen);
+      drawField(&state->screen, &state->field, &state->defaultField, &state->progress, BOARD_DIMENSION,
+                MIDDLE, MIDDLE);
+      composeScreenUpdate(&state->screen, INT_MAX);
+
+      return true;
+}
+
+// Times every iteration on its own after a few untimed ones, with the random generator of the
+// iteration seeded outside of the time.
+void runBenchmark(const Benchmark *benchmark, const uint64_t iterationsCount, BenchState *state,
+                  BenchResult *result) {
+      std::vector<uint64_t> samples(iterationsCount);
+
+      for (uint64_t i = 0; i < WARMUP_ITERATIONS_COUNT; i++) {
+            seedRandom(&state->random, BENCH_SEED, iterationsCount + i);
+            benchmark->run(state, iterationsCount + i);
+      }
+
+      state->checksum = 0;
+
+      for (uint64_t i = 0; i < iterationsCount; i++) {
+            seedRandom(&state->random, BENCH_SEED, i);
+
+            auto startTime = std::chrono::steady_clock::now();
+
+            benchmark->run(state, i);
+
+            auto elapsed = std::chrono::steady_clock::now() - startTime;
+
+            samples[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+      }
+
+      std::sort(samples.begin(), samples.end());
+
+      double totalNanoseconds = 0;
+      for (uint64_t sample : samples) totalNanoseconds += sample;
+
+      result->name = benchmark->name;
+      result->iterationsCount = iterationsCount;
+      result->min = samples.front();
+      result->p50 = getPercentile(&samples, 50);
+      result->p90 = getPercentile(&samples, 90);
+      result->p99 = getPercentile(&samples, 99);
+      result->max = samples.back();
+      result->mean = totalNanoseconds / iterationsCount;
+      result->checksum = state->checksum;
+}
+
+// Nearest-rank percentile: the smallest sample which at least percent of the samples don't exceed.
+uint64_t getPercentile(const std::vector<uint64_t> *sortedSamples, const int percent) {
+      const size_t count = sortedSamples->size();
+      const size_t rank = (count * percent + 99) / 100;
+
+      return (*sortedSamples)[rank == 0 ? 0 : rank - 1];
+}
+
+void appendBenchReport(const BenchOptions *options, const BenchState *state,
+                       const std::vector<BenchResult> *results, std::vector<char> *output) {
+      char line[512];
+      int length = snprintf(line, sizeof(line),
+                            "{\n  \"seed\": %llu,\n  \"kernel\": \"%s\",\n  \"corpus\": {\"path\": \"%s\", "
+                            "\"puzzles\": %zu},\n  \"unit\": \"ns\",\n  \"benchmarks\": [",
+                            (unsigned long long)BENCH_SEED, PROPAGATION_KERNEL_NAMES[options->kernel],
+                            options->corpusPath, state->puzzles.size());
+
+      output->insert(output->end(), line, line + length);
+
+      for (size_t i = 0; i < results->size(); i++) {
+            const BenchResult *result = &(*results)[i];
+
+            length = snprintf(line, sizeof(line),
+                              "%s\n    {\"name\": \"%s\", \"iterations\": %llu, \"min\": %llu, "
+                              "\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu, \"mean\": %.1f, "
+                              "\"checksum\": %llu}",
+                              i == 0 ? "" : ",", result->name, (unsigned long long)result->iterationsCount,
+                              (unsigned long long)result->min, (unsigned long long)result->p50,
+                              (unsigned long long)result->p90, (unsigned long long)result->p99,
+                              (unsigned long long)result->max, result->mean,
+                              (unsigned long long)result->checksum);
+
+            output->insert(output->end(), line, line + length);
+      }
+
+      length = snprintf(line, sizeof(line), "\n  ]\n}\n");
+      output->insert(output->end(), line, line + length);
+}
+
+void benchFillRowMajor(BenchState *state, const uint64_t) {
+      Board board;
+
+      state->checksum += fillMtrxOfRandomDigitsFully(&board, BOARD_DIMENSION, &state->random);
+}
+
+void benchFillMostConstrained(BenchState *state, const uint64_t) {
+      Board board;
+
+      state->checksum += fillMtrxByMostConstrainedCells(&board, &state->random);
+}
+
+void benchFill16MostConstrained(BenchState *state, const uint64_t) {
+      BasicBoard<4> board;
+
+      state->checksum += fillMtrxByMostConstrainedCells(&board, &state->random);
+}
+
+void benchFill25MostConstrained(BenchState *state, const uint64_t) {
+      BasicBoard<5> board;
+
+      state->checksum += fillMtrxByMostConstrainedCells(&board, &state->random);
+}
+
+// Clue hiding starts from the solutions of the corpus, so it doesn't pay for the filling.
+void benchHideEasy(BenchState *state, const uint64_t iteration) {
+      Board puzzle = state->solutions[iteration % state->solutions.size()];
+
+      hideAnyRandomDigits(&puzzle, Difficulty::Easy, &state->random);
+      state->checksum += getCountOfShownDigits(&puzzle, BOARD_DIMENSION);
+}
+
+void benchHideMedium(BenchState *state, const uint64_t iteration) {
+      Board puzzle = state->solutions[iteration % state->solutions.size()];
+
+      hideAnyRandomDigits(&puzzle, Difficulty::Medium, &state->random);
+      state->checksum += getCountOfShownDigits(&puzzle, BOARD_DIMENSION);
+}
+
+void benchHideHard(BenchState *state, const uint64_t iteration) {
+      Board puzzle = state->solutions[iteration % state->solutions.size()];
+
+      hideAnyRandomDigits(&puzzle, Difficulty::Hard, &state->random);
+      state->checksum += getCountOfShownDigits(&puzzle, BOARD_DIMENSION);
+}
+
+void benchHideMinimal(BenchState *state, const uint64_t iteration) {
+      const Board *solution = &state->solutions[iteration % state->solutions.size()];
+
+      Board puzzle = *solution;
+
+      state->checksum += removeCluesToMinimum(&puzzle, solution, 0, false, &state->random);
+}
+
+// A move of the player: a digit, or clearing with 0, put into a random cell, and the count of the
+// correct digits the menu shows.
+void benchEnterDigit(BenchState *state, const uint64_t) {
+      const int row = getRandomInt(&state->random, BOARD_DIMENSION);
+      const int col = getRandomInt(&state->random, BOARD_DIMENSION);
+      const int digit = getRandomInt(&state->random, BOARD_DIMENSION + 1);
+
+      int countOfCorrectDigitsShown;
+
+      changeSell(&state->field, &state->defaultField, &state->progress, row, col, digit);
+      setCountOfCorrectDigitsShown(countOfCorrectDigitsShown, &state->progress);
+
+      state->checksum += countOfCorrectDigitsShown;
+}
+
+void benchCheckField(BenchState *state, const uint64_t) {
+      for (int row = 0; row < BOARD_DIMENSION; row++) {
+            for (int col = 0; col < BOARD_DIMENSION; col++)
+                  state->checksum += isEnteredDigitCorrect(&state->field, row, col);
+      }
+}
+
+// Solving goes up to a second solution, as the solve mode does to tell a unique one.
+void benchSolveBitmask(BenchState *state, const uint64_t iteration) {
+      Board solution;
+
+      state->checksum += findSolutions(&state->puzzles[iteration % state->puzzles.size()], 2, &solution,
+                                       SolverBackend::Bitmask);
+}
+
+void benchSolveDlx(BenchState *state, const uint64_t iteration) {
+      Board solution;
+
+      state->checksum += findSolutions(&state->puzzles[iteration % state->puzzles.size()], 2, &solution,
+                                       SolverBackend::DancingLinks);
+}
+
+void benchGrade(BenchState *state, const uint64_t iteration) {
+      state->checksum += gradePuzzle(&state->puzzles[iteration % state->puzzles.size()]).rating;
+}
+
+void benchHint(BenchState *state, const uint64_t iteration) {
+      const size_t index = iteration % state->puzzles.size();
+
+      Hint hint;
+      findHint(&state->puzzles[index], &state->solutions[index], &hint);
+
+      state->checksum += hint.cell * BOARD_DIMENSION + hint.digit;
+}
+
+// A frame of the game after a move of the cursor, composed into the output buffer of the screen and
+// dropped there instead of being written to a terminal.
+void benchDrawField(BenchState *state, const uint64_t iteration) {
+      const int playerPosX = iteration % BOARD_DIMENSION;
+      const int playerPosY = iteration / BOARD_DIMENSION % BOARD_DIMENSION;
+
+      clearScreen(&state->screen);
+      drawField(&state->screen, &state->field, &state->defaultField, &state->progress, BOARD_DIMENSION,
+                playerPosX, playerPosY);
+      composeScreenUpdate(&state->screen, INT_MAX);
+
+      state->checksum += state->screen.output.size();
+}
@@ -0,0 +1,345 @@
+// sudoku_loadgen.cpp - load generator of sudoku serve: sessions per second and latency per command
+#include "sudoku.h"
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+const int LOAD_REPLY_SIZE = 256;
+const int MAX_LOAD_EVENTS = 256;
+
+struct LoadOptions {
+      const char *socketPath;
+      uint64_t sessionsCount;
+      uint64_t concurrency;
+      uint64_t commandsCount;  // per session, after the show which starts it
+      uint64_t seed;
+};
+
+enum LoadCommand {
+      StartCommand,
+      MoveCommand,
+      SetCommand,
+      ClearCommand,
+      HintCommand,
+      ResetCommand,
+      NewCommand,
+      LOAD_COMMANDS_COUNT
+};
+
+const char *const LOAD_COMMAND_NAMES[LOAD_COMMANDS_COUNT] = {"start", "move",  "set", "clear",
+                                                             "hint",  "reset", "new"};
+
+// Percent of the commands of every kind, mostly moves and digits as a player would send them. The
+// start is the first command of every session and nothing else.
+const int LOAD_COMMAND_PERCENTS[LOAD_COMMANDS_COUNT] = {0, 50, 25, 10, 6, 5, 4};
+
+// Session of one connection, with at most one command on the way: the next one is sent once the
+// reply to the last one is in.
+struct LoadClient {
+      int fd;
+      uint64_t commandsLeft;
+      LoadCommand command;
+      uint64_t sentNs;
+      char reply[LOAD_REPLY_SIZE];
+      int replyLength;
+};
+
+struct LoadState {
+      const LoadOptions *options;
+      int epollFd;
+      Random random;
+      uint64_t startedSessionsCount, finishedSessionsCount, errorsCount;
+      Histogram latencies[LOAD_COMMANDS_COUNT];
+};
+
+bool parseLoadOptions(int argc, char *argv[], LoadOptions *options);
+bool startLoadClient(LoadState *state, LoadClient *client);
+bool sendLoadCommand(LoadState *state, LoadClient *client, const LoadCommand command);
+LoadCommand pickLoadCommand(Random *random);
+void readLoadReply(LoadState *state, LoadClient *client);
+void finishLoadClient(LoadState *state, LoadClient *client);
+void recordLatency(Histogram *histogram, const uint64_t value);
+void appendLoadReport(const LoadState *state, const uint64_t elapsedNs, std::vector<char> *output);
+
+int main(int argc, char *argv[]) {
+      LoadOptions options;
+
+      if (!parseLoadOptions(argc, argv, &options)) {
+            std::cerr << "Usage: sudoku_loadgen --socket PATH [--sessions N] [--concurrency N]\n"
+                         "                      [--commands N] [--seed N]\n"
+                         "Plays --sessions games against sudoku serve, --concurrency of them at a time,\n"
+                         "each a connection which sends show and then --commands random commands, one at\n"
+                         "a time.\n"
+                         "Reports sessions and commands per second and the latency of every command kind:\n"
+                         "start is the first show, which gives the session its field.\n";
+
+            return 1;
+      }
+
+      raiseOpenFilesLimit();
+
+      LoadState state{};
+      state.options = &options;
+      state.epollFd = epoll_create1(EPOLL_CLOEXEC);
+      seedRandom(&state.random, options.seed, 0);
+
+      for (Histogram &latencies : state.latencies) latencies.min = UINT64_MAX;
+
+      std::vector<LoadClient> clients(std::min(options.concurrency, options.sessionsCount));
+
+      const uint64_t startNs = getStatsClock();
+
+      for (LoadClient &client : clients) {
+            if (!startLoadClient(&state, &client)) {
+                  std::cerr << "Can't connect to " << options.socketPath << ": " << strerror(errno) << "."
+                            << std::endl;
+
+                  return 1;
+            }
+      }
+
+      epoll_event events[MAX_LOAD_EVENTS];
+
+      while (state.finishedSessionsCount < options.sessionsCount) {
+            const int eventsCount = epoll_wait(state.epollFd, events, MAX_LOAD_EVENTS, -1);
+
+            for (int i = 0; i < eventsCount; i++) readLoadReply(&state, (LoadClient *)events[i].data.ptr);
+      }
+
+      const uint64_t elapsedNs = getStatsClock() - startNs;
+
+      std::vector<char> report;
+      appendLoadReport(&state, elapsedNs, &report);
+
+      fwrite(report.data(), 1, report.size(), stdout);
+
+      return state.errorsCount == 0 ? 0 : 1;
+}
+
+bool parseLoadOptions(int argc, char *argv[], LoadOptions *options) {
+      options->socketPath = nullptr;
+      options->sessionsCount = 10000;
+      options->concurrency = 1000;
+      options->commandsCount = 20;
+      options->seed = 2026;
+
+      for (int i = 1; i < argc; i++) {
+            bool hasValue = i + 1 < argc;
+            bool isParsed = true;
+
+            if (strcmp(argv[i], "--socket") == 0 && hasValue) {
+                  options->socketPath = argv[++i];
+            } else if (strcmp(argv[i], "--sessions") == 0 && hasValue) {
+                  isParsed = parseUnsignedOption(argv[++i], &options->sessionsCount) &&
+                             options->sessionsCount > 0;
+            } else if (strcmp(argv[i], "--concurrency") == 0 && hasValue) {
+                  isParsed =
+                      parseUnsignedOption(argv[++i], &options->concurrency) && options->concurrency > 0;
+            } else if (strcmp(argv[i], "--commands") == 0 && hasValue) {
+                  isParsed = parseUnsignedOption(argv[++i], &options->commandsCount);
+            } else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+                  isParsed = parseUnsignedOption(argv[++i], &options->seed);
+            } else {
+                  isParsed = false;
+            }
+
+            if (!isParsed) return false;
+      }
+
+      return options->socketPath != nullptr;
+}
+
+// Connects while the server's backlog has room and waits when it hasn't, then starts the session.
+// On failure the socket is closed again, so no event of it comes back to the client.
+bool startLoadClient(LoadState *state, LoadClient *client) {
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+      strncpy(address.sun_path, state->options->socketPath, sizeof(address.sun_path) - 1);
+
+      state->startedSessionsCount++;
+      client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+      if (client->fd == -1) return false;
+
+      if (connect(client->fd, (const sockaddr *)&address, sizeof(address)) == -1) {
+            const int error = errno;
+
+            close(client->fd);
+            errno = error;
+
+            return false;
+      }
+
+      fcntl(client->fd, F_SETFL, fcntl(client->fd, F_GETFL) | O_NONBLOCK);
+
+      epoll_event event{};
+      event.events = EPOLLIN;
+      event.data.ptr = client;
+      epoll_ctl(state->epollFd, EPOLL_CTL_ADD, client->fd, &event);
+
+      client->commandsLeft = state->options->commandsCount;
+      client->replyLength = 0;
+
+      if (!sendLoadCommand(state, client, LoadCommand::StartCommand)) {
+            const int error = errno;
+
+            epoll_ctl(state->epollFd, EPOLL_CTL_DEL, client->fd, nullptr);
+            close(client->fd);
+            errno = error;
+
+            return false;
+      }
+
+      return true;
+}
+
+// A command is a few bytes, which an idle socket always takes at once.
+bool sendLoadCommand(LoadState *state, LoadClient *client, const LoadCommand command) {
+      const char *const MOVE_COMMANDS[] = {"move up\n", "move down\n", "move left\n", "move right\n"};
+
+      char line[16];
+      const char *text = line;
+
+      switch (command) {
+            case LoadCommand::StartCommand:
+                  text = "show\n";
+                  break;
+            case LoadCommand::MoveCommand:
+                  text = MOVE_COMMANDS[getRandomInt(&state->random, 4)];
+                  break;
+            case LoadCommand::SetCommand:
+                  snprintf(line, sizeof(line), "set %d\n", 1 + getRandomInt(&state->random, BOARD_DIMENSION));
+                  break;
+            case LoadCommand::ClearCommand:
+                  text = "clear\n";
+                  break;
+            case LoadCommand::HintCommand:
+                  text = "hint\n";
+                  break;
+            case LoadCommand::ResetCommand:
+                  text = "reset\n";
+                  break;
+            default:
+                  text = "new\n";
+                  break;
+      }
+
+      client->command = command;
+      client->sentNs = getStatsClock();
+
+      return send(client->fd, text, strlen(text), MSG_NOSIGNAL) == (ssize_t)strlen(text);
+}
+
+LoadCommand pickLoadCommand(Random *random) {
+      int percent = getRandomInt(random, 100);
+      int command = LoadCommand::StartCommand;
+
+      while (percent >= LOAD_COMMAND_PERCENTS[command]) percent -= LOAD_COMMAND_PERCENTS[command++];
+
+      return (LoadCommand)command;
+}
+
+// A reply other than ok or hint, or a socket which fails, counts as an error and ends the session.
+void readLoadReply(LoadState *state, LoadClient *client) {
+      const ssize_t readCount =
+          read(client->fd, client->reply + client->replyLength, LOAD_REPLY_SIZE - client->replyLength);
+
+      if (readCount == -1 && (errno == EAGAIN || errno == EINTR)) return;
+
+      const char *end = nullptr;
+
+      if (readCount > 0) {
+            end = (const char *)memchr(client->reply + client->replyLength, '\n', readCount);
+            client->replyLength += readCount;
+
+            if (end == nullptr && client->replyLength < LOAD_REPLY_SIZE) return;
+      }
+
+      const bool isReplied = end != nullptr && end + 1 == client->reply + client->replyLength &&
+                             (memcmp(client->reply, "ok ", 3) == 0 || memcmp(client->reply, "hint ", 5) == 0);
+
+      if (!isReplied) {
+            state->errorsCount++;
+            client->commandsLeft = 0;
+      } else {
+            recordLatency(&state->latencies[client->command], getStatsClock() - client->sentNs);
+      }
+
+      client->replyLength = 0;
+
+      if (client->commandsLeft == 0) {
+            finishLoadClient(state, client);
+
+            return;
+      }
+
+      client->commandsLeft--;
+
+      if (!sendLoadCommand(state, client, pickLoadCommand(&state->random))) {
+            state->errorsCount++;
+            finishLoadClient(state, client);
+      }
+}
+
+// Closes the session and starts the next one in its place while there are sessions left to start.
+void finishLoadClient(LoadState *state, LoadClient *client) {
+      close(client->fd);
+      state->finishedSessionsCount++;
+
+      if (state->startedSessionsCount < state->options->sessionsCount && !startLoadClient(state, client)) {
+            state->errorsCount++;
+            state->finishedSessionsCount++;
+      }
+}
+
+void recordLatency(Histogram *histogram, const uint64_t value) {
+      histogram->bucketCounts[getStatBucket(value)]++;
+      histogram->count++;
+      histogram->sum += value;
+      histogram->min = std::min(histogram->min, value);
+      histogram->max = std::max(histogram->max, value);
+}
+
+void appendLoadReport(const LoadState *state, const uint64_t elapsedNs, std::vector<char> *output) {
+      char line[256];
+
+      Histogram total{};
+      total.min = UINT64_MAX;
+
+      for (const Histogram &latencies : state->latencies) addHistogram(&latencies, &total);
+
+      const double elapsedSeconds = elapsedNs / 1e9;
+
+      int length = snprintf(line, sizeof(line),
+                            "Ran %llu sessions of %llu commands, %llu at a time, in %.3f s: %.1f sessions/s, "
+                            "%.1f commands/s, %llu errors.\n",
+                            (unsigned long long)state->finishedSessionsCount,
+                            (unsigned long long)state->options->commandsCount + 1,
+                            (unsigned long long)state->options->concurrency, elapsedSeconds,
+                            state->finishedSessionsCount / elapsedSeconds, total.count / elapsedSeconds,
+                            (unsigned long long)state->errorsCount);
+      output->insert(output->end(), line, line + length);
+
+      length = snprintf(line, sizeof(line), "  %-12s %10s %10s %10s %10s %10s %10s %12s\n", "latency (ns)",
+                        "count", "min", "p50", "p90", "p99", "max", "mean");
+      output->insert(output->end(), line, line + length);
+
+      for (int command = 0; command <= LOAD_COMMANDS_COUNT; command++) {
+            const Histogram *histogram = command == LOAD_COMMANDS_COUNT ? &total : &state->latencies[command];
+
+            if (histogram->count == 0) continue;
+
+            length = snprintf(line, sizeof(line),
+                              "  %-12s %10llu %10llu %10llu %10llu %10llu %10llu %12.1f\n",
+                              command == LOAD_COMMANDS_COUNT ? "all" : LOAD_COMMAND_NAMES[command],
+                              (unsigned long long)histogram->count, (unsigned long long)histogram->min,
+                              (unsigned long long)getHistogramPercentile(histogram, 50),
+                              (unsigned long long)getHistogramPercentile(histogram, 90),
+                              (unsigned long long)getHistogramPercentile(histogram, 99),
+                              (unsigned long long)histogram->max, (double)histogram->sum / histogram->count);
+            output->insert(output->end(), line, line + length);
+      }
+}
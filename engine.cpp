@@ -0,0 +1,1195 @@
+// engine.cpp - random numbers, the solvers, grading, hints and canonical forms of puzzles
+#include "sudoku.h"
+
+typedef uint16_t Lanes16 __attribute__((vector_size(32)));
+typedef uint16_t Lanes8 __attribute__((vector_size(16)));
+typedef uint8_t Bytes16 __attribute__((vector_size(16)));
+
+// A row of the 9x9 field for the vector kernels: a 16-bit lane per cell, lanes 9..15 unused. It
+// takes one AVX2 register or two SSE2 ones; the kernels are written once over both and compiled
+// for each instruction set.
+template <typename Vector>
+struct RowLanes {
+      static constexpr int WIDTH = sizeof(Vector) / sizeof(uint16_t);
+      static constexpr int PARTS_COUNT = 16 / WIDTH;
+
+      Vector parts[PARTS_COUNT];
+};
+
+template <typename Vector>
+bool propagateSinglesInLanes(SolverState<BOARD_SECTION_LEN> *state);
+template <typename Vector>
+bool placeSingleInLanes(SolverState<BOARD_SECTION_LEN> *state, RowLanes<Vector> *hiddenLanes, const int cell,
+                        const int digit);
+template <typename Vector>
+RowLanes<Vector> operator&(const RowLanes<Vector> &left, const RowLanes<Vector> &right);
+template <typename Vector>
+RowLanes<Vector> operator|(const RowLanes<Vector> &left, const RowLanes<Vector> &right);
+template <typename Vector>
+RowLanes<Vector> &operator|=(RowLanes<Vector> &left, const RowLanes<Vector> &right);
+template <typename Vector>
+RowLanes<Vector> operator~(const RowLanes<Vector> &lanes);
+template <typename Vector>
+RowLanes<Vector> getBroadcastLanes(const uint16_t value);
+template <typename Vector>
+RowLanes<Vector> loadLanes(const uint16_t *values);
+template <typename Vector>
+RowLanes<Vector> getHiddenLanes(const uint8_t *digits);
+template <typename Vector>
+RowLanes<Vector> getZeroLanes(const RowLanes<Vector> &lanes);
+template <typename Vector>
+RowLanes<Vector> getSingleBitLanes(const RowLanes<Vector> &lanes);
+template <int COUNT, typename Vector>
+RowLanes<Vector> shiftLanesDown(const RowLanes<Vector> &lanes);
+template <typename Vector>
+bool isAnyLaneSet(const RowLanes<Vector> &lanes);
+template <typename Vector>
+uint16_t getLane(const RowLanes<Vector> &lanes, const int index);
+template <typename Vector>
+void setLane(RowLanes<Vector> *lanes, const int index, const uint16_t value);
+
+// Kernel of the 9x9 bitmask solver: the fastest one the CPU supports, unless an option picks
+// another before any solving thread starts.
+PropagationKernel boardPropagationKernel = getBestPropagationKernel();
+
+// Maps the puzzle to the least of its equivalents, read as a string of 81 digits with 0 for the
+// hidden cells, under transposition, swaps of bands and stacks, swaps of rows and columns within
+// them and renaming of the digits; equivalent puzzles get the same digits and the same 64-bit hash.
+// The rows are fixed one by one: every transformation whose rows so far spell the least prefix is
+// kept, and the digits are renamed in the order they are met, which is the least naming for the
+// rows chosen. The first row only needs its hidden cells as far left as possible, so the columns
+// it allows are enumerated directly.
+uint64_t canonicalizePuzzle(const Board *puzzle, Canonicalizer *canonicalizer, uint8_t *canonicalDigits) {
+      uint8_t views[2][BOARD_CELLS_COUNT];
+
+      for (int cell = 0; cell < BOARD_CELLS_COUNT; cell++) {
+            const int row = cell / BOARD_DIMENSION, col = cell % BOARD_DIMENSION;
+
+            views[0][cell] = puzzle->digits[cell];
+            views[1][col * BOARD_DIMENSION + row] = puzzle->digits[cell];
+      }
+
+      std::vector<CanonicalState> *states = &canonicalizer->states;
+      std::vector<CanonicalState> *nextStates = &canonicalizer->nextStates;
+
+      int bestMask = 1 << BOARD_DIMENSION;
+      states->clear();
+
+      for (int isTransposed = 0; isTransposed < 2; isTransposed++)
+            for (int row = 0; row < BOARD_DIMENSION; row++)
+                  addFirstCanonicalRows(views[isTransposed], isTransposed, row, states, &bestMask);
+
+      for (int col = 0, label = 0; col < BOARD_DIMENSION; col++)
+            canonicalDigits[col] = (bestMask >> (BOARD_DIMENSION - 1 - col)) & 1 ? ++label : 0;
+
+      for (int rowIndex = 1; rowIndex < BOARD_DIMENSION; rowIndex++) {
+            uint8_t *bestRow = canonicalDigits + rowIndex * BOARD_DIMENSION;
+            bool isBestFound = false;
+
+            nextStates->clear();
+
+            for (const CanonicalState &state : *states) {
+                  const uint8_t *digits = views[state.isTransposed];
+
+                  // A new band may be any unused one, else the row comes from the current band.
+                  for (int row = 0; row < BOARD_DIMENSION; row++) {
+                        const int band = row / BOARD_SECTION_LEN;
+                        const bool isBandUsed = (state.usedRows >> (band * BOARD_SECTION_LEN) & 7) != 0;
+                        const bool isRowUsed = (state.usedRows & 1 << row) != 0;
+
+                        bool isAllowed = rowIndex % BOARD_SECTION_LEN == 0 ? !isBandUsed
+                                                                           : band == state.band && !isRowUsed;
+
+                        if (isAllowed)
+                              addNextCanonicalRow(digits, &state, row, bestRow, &isBestFound, nextStates);
+                  }
+            }
+
+            std::swap(states, nextStates);
+      }
+
+      uint64_t hash = 0;
+
+      for (int firstCell = 0; firstCell < BOARD_CELLS_COUNT; firstCell += 16) {
+            uint64_t word = 0;
+
+            for (int cell = firstCell; cell < firstCell + 16 && cell < BOARD_CELLS_COUNT; cell++)
+                  word = word << 4 | canonicalDigits[cell];
+
+            uint64_t mixState = hash ^ word;
+            hash = getSplitMix64(&mixState);
+      }
+
+      return hash;
+}
+
+// Adds the transformations which put the row first with its shown cells as far right as possible,
+// if that is no worse than the first rows found so far. A stack's best pattern has its shown
+// cells at the right, and the stacks go from the fewest shown cells to the most.
+void addFirstCanonicalRows(const uint8_t *digits, const bool isTransposed, const int row,
+                           std::vector<CanonicalState> *states, int *bestMask) {
+      const uint8_t *line = digits + row * BOARD_DIMENSION;
+
+      int stackMasks[BOARD_SECTION_LEN];
+      int stackPermutations[BOARD_SECTION_LEN][6];
+      int stackPermutationsCounts[BOARD_SECTION_LEN] = {};
+
+      for (int stack = 0; stack < BOARD_SECTION_LEN; stack++) {
+            const uint8_t *stackLine = line + stack * BOARD_SECTION_LEN;
+
+            stackMasks[stack] = (1 << ((stackLine[0] != 0) + (stackLine[1] != 0) + (stackLine[2] != 0))) - 1;
+
+            for (int permutation = 0; permutation < 6; permutation++) {
+                  const int *order = PERMUTATIONS_OF_3[permutation];
+                  int mask = (stackLine[order[0]] != 0) << 2 | (stackLine[order[1]] != 0) << 1 |
+                             (stackLine[order[2]] != 0);
+
+                  if (mask == stackMasks[stack])
+                        stackPermutations[stack][stackPermutationsCounts[stack]++] = permutation;
+            }
+      }
+
+      int sortedMasks[BOARD_SECTION_LEN] = {stackMasks[0], stackMasks[1], stackMasks[2]};
+      std::sort(sortedMasks, sortedMasks + BOARD_SECTION_LEN);
+
+      const int mask = sortedMasks[0] << 6 | sortedMasks[1] << 3 | sortedMasks[2];
+
+      if (mask > *bestMask) return;
+
+      if (mask < *bestMask) {
+            states->clear();
+            *bestMask = mask;
+      }
+
+      CanonicalState state{};
+      state.band = row / BOARD_SECTION_LEN;
+      state.usedRows = 1 << row;
+      state.isTransposed = isTransposed;
+
+      for (const int *stacks : PERMUTATIONS_OF_3) {
+            const bool isSorted = stackMasks[stacks[0]] <= stackMasks[stacks[1]] &&
+                                  stackMasks[stacks[1]] <= stackMasks[stacks[2]];
+
+            if (!isSorted) continue;
+
+            for (int i0 = 0; i0 < stackPermutationsCounts[stacks[0]]; i0++) {
+                  for (int i1 = 0; i1 < stackPermutationsCounts[stacks[1]]; i1++) {
+                        for (int i2 = 0; i2 < stackPermutationsCounts[stacks[2]]; i2++) {
+                              const int choices[BOARD_SECTION_LEN] = {i0, i1, i2};
+
+                              for (int k = 0; k < BOARD_SECTION_LEN; k++) {
+                                    const int stack = stacks[k];
+                                    const int permutation = stackPermutations[stack][choices[k]];
+                                    const int *order = PERMUTATIONS_OF_3[permutation];
+
+                                    for (int i = 0; i < BOARD_SECTION_LEN; i++)
+                                          state.columns[k * BOARD_SECTION_LEN + i] =
+                                              stack * BOARD_SECTION_LEN + order[i];
+                              }
+
+                              memset(state.labels, 0, sizeof(state.labels));
+                              state.nextLabel = 1;
+
+                              for (int col = 0; col < BOARD_DIMENSION; col++) {
+                                    const int digit = line[state.columns[col]];
+
+                                    if (digit != 0) state.labels[digit] = state.nextLabel++;
+                              }
+
+                              states->push_back(state);
+                        }
+                  }
+            }
+      }
+}
+
+// Extends the transformation with the row as the next one, if the row then reads no worse than
+// the best one found so far for that place.
+void addNextCanonicalRow(const uint8_t *digits, const CanonicalState *state, const int row, uint8_t *bestRow,
+                         bool *isBestFound, std::vector<CanonicalState> *nextStates) {
+      const uint8_t *line = digits + row * BOARD_DIMENSION;
+
+      CanonicalState next = *state;
+      uint8_t values[BOARD_DIMENSION];
+
+      // Most rows lose to the best one within the first few cells.
+      int order = *isBestFound ? 0 : -1;
+
+      for (int col = 0; col < BOARD_DIMENSION; col++) {
+            const int digit = line[next.columns[col]];
+
+            if (digit != 0 && next.labels[digit] == 0) next.labels[digit] = next.nextLabel++;
+
+            values[col] = next.labels[digit];
+
+            if (order == 0 && values[col] != bestRow[col]) order = values[col] < bestRow[col] ? -1 : 1;
+            if (order > 0) return;
+      }
+
+      if (order < 0) {
+            memcpy(bestRow, values, BOARD_DIMENSION);
+            *isBestFound = true;
+            nextStates->clear();
+      }
+
+      next.band = row / BOARD_SECTION_LEN;
+      next.usedRows |= 1 << row;
+
+      nextStates->push_back(next);
+}
+
+// Sizes the set for twice as many slots as puzzles, so the probes stay short.
+void initDistinctSet(DistinctSet *set, const uint64_t puzzlesCount) {
+      const uint64_t MIN_SHARD_CAPACITY = 1024;
+
+      uint64_t shardCapacity = MIN_SHARD_CAPACITY;
+
+      while (shardCapacity * DISTINCT_SHARDS_COUNT < 2 * puzzlesCount) shardCapacity *= 2;
+
+      for (DistinctSetShard &shard : set->shards) {
+            shard.slots = new std::atomic<uint64_t>[shardCapacity];
+            shard.mask = shardCapacity - 1;
+
+            for (uint64_t i = 0; i < shardCapacity; i++)
+                  shard.slots[i].store(EMPTY_DISTINCT_SLOT, std::memory_order_relaxed);
+      }
+
+      set->duplicatesCount.store(0, std::memory_order_relaxed);
+}
+
+void freeDistinctSet(DistinctSet *set) {
+      for (DistinctSetShard &shard : set->shards) delete[] shard.slots;
+}
+
+// Returns false when the hash is in the set already. A full shard takes every puzzle as new.
+bool insertDistinctPuzzle(DistinctSet *set, uint64_t hash) {
+      if (hash == EMPTY_DISTINCT_SLOT) hash = 1;
+
+      DistinctSetShard *shard = &set->shards[hash >> (64 - DISTINCT_SHARD_BITS)];
+
+      for (uint64_t probe = 0; probe <= shard->mask; probe++) {
+            std::atomic<uint64_t> *slot = &shard->slots[(hash + probe) & shard->mask];
+            uint64_t value = slot->load(std::memory_order_relaxed);
+
+            if (value == EMPTY_DISTINCT_SLOT &&
+                slot->compare_exchange_strong(value, hash, std::memory_order_relaxed))
+                  return true;
+
+            if (value == hash) {
+                  set->duplicatesCount.fetch_add(1, std::memory_order_relaxed);
+
+                  return false;
+            }
+      }
+
+      return true;
+}
+
+// Seeds the generator with the given stream of the seed. Streams of one seed are independent, so
+// a batch gives puzzle i stream i and any puzzle can be regenerated from (seed, i) alone.
+void seedRandom(Random *random, const uint64_t seed, const uint64_t stream) {
+      uint64_t streamState = stream;
+      uint64_t splitMixState = seed ^ getSplitMix64(&streamState);
+
+      for (uint64_t &word : random->state) word = getSplitMix64(&splitMixState);
+}
+
+// Singles propagation of the 9x9 solver with the kernel picked at startup.
+bool propagateBoardSingles(SolverState<BOARD_SECTION_LEN> *state) {
+      switch (boardPropagationKernel) {
+            case PropagationKernel::Sse2:
+                  return propagateSinglesWithSse2(state);
+            case PropagationKernel::Avx2:
+                  return propagateSinglesWithAvx2(state);
+            default:
+                  return propagateSingles(state);
+      }
+}
+
+// propagateSingles over whole rows of candidates. Every pass computes the candidates of all the 81
+// cells from the unit masks with a few vector operations per row, then places all the naked
+// singles it found, or if there are none, all the hidden singles. The digits a unit has as a
+// candidate once and twice or more are combined lane-wise: columns across the rows, sections first
+// within the lanes of a row and then across the rows of a band, and rows across their three
+// sections. Placing the singles of a pass together ends up in the same state as placing them one
+// by one, since neither order can miss a single the other one finds.
+template <typename Vector>
+inline __attribute__((always_inline)) bool propagateSinglesInLanes(SolverState<BOARD_SECTION_LEN> *state) {
+      using Row = RowLanes<Vector>;
+
+      const int DIMENSION = BOARD_DIMENSION, SECTION_LEN = BOARD_SECTION_LEN;
+      const uint16_t STACK_LANES[SECTION_LEN][16] = {{0xFFFF, 0xFFFF, 0xFFFF},
+                                                     {0, 0, 0, 0xFFFF, 0xFFFF, 0xFFFF},
+                                                     {0, 0, 0, 0, 0, 0, 0xFFFF, 0xFFFF, 0xFFFF}};
+
+      const Row ALL_DIGITS = getBroadcastLanes<Vector>(ALL_DIGITS_MASK);
+
+      Row stackLanes[SECTION_LEN], hiddenLanes[DIMENSION], candidates[DIMENSION];
+
+      for (int stack = 0; stack < SECTION_LEN; stack++)
+            stackLanes[stack] = loadLanes<Vector>(STACK_LANES[stack]);
+
+      for (int row = 0; row < DIMENSION; row++)
+            hiddenLanes[row] = getHiddenLanes<Vector>(&state->digits[row * DIMENSION]);
+
+      while (state->hiddenCount != 0) {
+            const Row colsUsed = loadLanes<Vector>(&state->usedMasks[COL_UNIT * DIMENSION]);
+
+            Row bandsUsed[SECTION_LEN] = {};
+            for (int band = 0; band < SECTION_LEN; band++) {
+                  for (int stack = 0; stack < SECTION_LEN; stack++) {
+                        const int unit = SECTION_UNIT * DIMENSION + band * SECTION_LEN + stack;
+                        const Row used = getBroadcastLanes<Vector>(state->usedMasks[unit]);
+
+                        bandsUsed[band] |= used & stackLanes[stack];
+                  }
+            }
+
+            Row emptyLanes{}, singleLanes[DIMENSION], anySingleLanes{};
+
+            for (int row = 0; row < DIMENSION; row++) {
+                  const Row rowUsed = getBroadcastLanes<Vector>(state->usedMasks[ROW_UNIT * DIMENSION + row]);
+
+                  const Row used = rowUsed | colsUsed | bandsUsed[row / SECTION_LEN];
+
+                  candidates[row] = hiddenLanes[row] & ALL_DIGITS & ~used;
+                  singleLanes[row] = getSingleBitLanes(candidates[row]);
+
+                  emptyLanes |= getZeroLanes(candidates[row]) & hiddenLanes[row];
+                  anySingleLanes |= singleLanes[row];
+            }
+
+            if (isAnyLaneSet(emptyLanes)) return false;
+
+            if (isAnyLaneSet(anySingleLanes)) {
+                  for (int row = 0; row < DIMENSION; row++) {
+                        if (!isAnyLaneSet(singleLanes[row])) continue;
+
+                        for (int col = 0; col < DIMENSION; col++) {
+                              if (getLane(singleLanes[row], col) == 0) continue;
+
+                              const int digit = __builtin_ctz(getLane(candidates[row], col)) + 1;
+
+                              if (!placeSingleInLanes(state, hiddenLanes, row * DIMENSION + col, digit))
+                                    return false;
+                        }
+                  }
+
+                  continue;
+            }
+
+            uint16_t onceMasks[UNITS_COUNT], twiceMasks[UNITS_COUNT];
+            Row colsOnce{}, colsTwice{};
+
+            for (int band = 0; band < SECTION_LEN; band++) {
+                  Row sectionsOnce{}, sectionsTwice{};
+
+                  for (int row = band * SECTION_LEN; row < (band + 1) * SECTION_LEN; row++) {
+                        const Row lanes = candidates[row];
+
+                        colsTwice |= colsOnce & lanes;
+                        colsOnce |= lanes;
+
+                        // The three cells of every section in the row, gathered in lanes 0, 3 and 6.
+                        const Row second = shiftLanesDown<1>(lanes), third = shiftLanesDown<2>(lanes);
+                        const Row pairOnce = lanes | second, pairTwice = lanes & second;
+                        const Row once = pairOnce | third, twice = pairTwice | (pairOnce & third);
+
+                        sectionsTwice |= twice | (sectionsOnce & once);
+                        sectionsOnce |= once;
+
+                        // The whole row in lane 0.
+                        const Row middleOnce = shiftLanesDown<SECTION_LEN>(once);
+                        const Row lastOnce = shiftLanesDown<2 * SECTION_LEN>(once);
+                        const Row firstTwoOnce = once | middleOnce;
+                        const Row rowTwice = twice | shiftLanesDown<SECTION_LEN>(twice) |
+                                             shiftLanesDown<2 * SECTION_LEN>(twice) | (once & middleOnce) |
+                                             (firstTwoOnce & lastOnce);
+
+                        onceMasks[ROW_UNIT * DIMENSION + row] = getLane(firstTwoOnce | lastOnce, 0);
+                        twiceMasks[ROW_UNIT * DIMENSION + row] = getLane(rowTwice, 0);
+                  }
+
+                  for (int stack = 0; stack < SECTION_LEN; stack++) {
+                        const int unit = SECTION_UNIT * DIMENSION + band * SECTION_LEN + stack;
+
+                        onceMasks[unit] = getLane(sectionsOnce, stack * SECTION_LEN);
+                        twiceMasks[unit] = getLane(sectionsTwice, stack * SECTION_LEN);
+                  }
+            }
+
+            for (int col = 0; col < DIMENSION; col++) {
+                  onceMasks[COL_UNIT * DIMENSION + col] = getLane(colsOnce, col);
+                  twiceMasks[COL_UNIT * DIMENSION + col] = getLane(colsTwice, col);
+            }
+
+            bool isChanged = false;
+
+            for (int unit = 0; unit < UNITS_COUNT; unit++) {
+                  if ((onceMasks[unit] | state->usedMasks[unit]) != ALL_DIGITS_MASK) return false;
+
+                  const uint32_t singles = onceMasks[unit] & ~twiceMasks[unit];
+
+                  for (uint32_t rest = singles; rest != 0; rest &= rest - 1) {
+                        const uint32_t bit = rest & -rest;
+
+                        for (int cell : CELL_LAYOUT<BOARD_SECTION_LEN>.unitCells[unit]) {
+                              const int row = cell / DIMENSION, col = cell % DIMENSION;
+
+                              if ((getLane(candidates[row], col) & bit) == 0) continue;
+
+                              if (!placeSingleInLanes(state, hiddenLanes, cell, __builtin_ctz(bit) + 1))
+                                    return false;
+
+                              break;
+                        }
+                  }
+
+                  isChanged |= singles != 0;
+            }
+
+            if (!isChanged) return true;
+      }
+
+      return true;
+}
+
+bool propagateSinglesWithSse2(SolverState<BOARD_SECTION_LEN> *state) {
+      return propagateSinglesInLanes<Lanes8>(state);
+}
+
+__attribute__((target("avx2"))) bool propagateSinglesWithAvx2(SolverState<BOARD_SECTION_LEN> *state) {
+      return propagateSinglesInLanes<Lanes16>(state);
+}
+
+// Places a single found in a pass unless an earlier single of the same pass took its cell or its
+// digit, which makes the state contradictory. Returns false in that case; a cell which got the same
+// digit from another unit already is fine.
+template <typename Vector>
+inline __attribute__((always_inline)) bool placeSingleInLanes(SolverState<BOARD_SECTION_LEN> *state,
+                                                              RowLanes<Vector> *hiddenLanes, const int cell,
+                                                              const int digit) {
+      if (state->digits[cell] != 0) return state->digits[cell] == digit;
+
+      if ((getSolverCandidates(state, cell) & getDigitBit(digit)) == 0) return false;
+
+      placeSolverDigit(state, cell, digit);
+      setLane(&hiddenLanes[cell / BOARD_DIMENSION], cell % BOARD_DIMENSION, 0);
+
+      return true;
+}
+
+template <typename Vector>
+inline __attribute__((always_inline)) RowLanes<Vector> operator&(const RowLanes<Vector> &left,
+                                                                 const RowLanes<Vector> &right) {
+      RowLanes<Vector> result;
+
+      for (int i = 0; i < RowLanes<Vector>::PARTS_COUNT; i++)
+            result.parts[i] = left.parts[i] & right.parts[i];
+
+      return result;
+}
+
+template <typename Vector>
+inline __attribute__((always_inline)) RowLanes<Vector> operator|(const RowLanes<Vector> &left,
+                                                                 const RowLanes<Vector> &right) {
+      RowLanes<Vector> result;
+
+      for (int i = 0; i < RowLanes<Vector>::PARTS_COUNT; i++)
+            result.parts[i] = left.parts[i] | right.parts[i];
+
+      return result;
+}
+
+template <typename Vector>
+inline __attribute__((always_inline)) RowLanes<Vector> &operator|=(RowLanes<Vector> &left,
+                                                                   const RowLanes<Vector> &right) {
+      return left = left | right;
+}
+
+template <typename Vector>
+inline __attribute__((always_inline)) RowLanes<Vector> operator~(const RowLanes<Vector> &lanes) {
+      RowLanes<Vector> result;
+
+      for (int i = 0; i < RowLanes<Vector>::PARTS_COUNT; i++) result.parts[i] = ~lanes.parts[i];
+
+      return result;
+}
+
+template <typename Vector>
+inline __attribute__((always_inline)) RowLanes<Vector> getBroadcastLanes(const uint16_t value) {
+      RowLanes<Vector> result;
+
+      for (int i = 0; i < RowLanes<Vector>::PARTS_COUNT; i++) result.parts[i] = Vector{} + value;
+
+      return result;
+}
+
+// Lanes 0..15 from 16 values in memory.
+template <typename Vector>
+inline __attribute__((always_inline)) RowLanes<Vector> loadLanes(const uint16_t *values) {
+      RowLanes<Vector> result;
+      memcpy(result.parts, values, sizeof(result.parts));
+
+      return result;
+}
+
+// All ones in the lanes of the row's hidden cells, 0 elsewhere.
+template <typename Vector>
+inline __attribute__((always_inline)) RowLanes<Vector> getHiddenLanes(const uint8_t *digits) {
+      const Bytes16 ROW_BYTES = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+      Bytes16 bytes;
+      memset(&bytes, 0, sizeof(bytes));
+      memcpy(&bytes, digits, BOARD_DIMENSION);
+
+      // Every byte doubled up is a 16-bit lane of the same flag.
+      const Bytes16 hidden = (Bytes16)(bytes == 0) & ROW_BYTES;
+      const Bytes16 low =
+          __builtin_shufflevector(hidden, hidden, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+      const Bytes16 high =
+          __builtin_shufflevector(hidden, hidden, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15);
+
+      RowLanes<Vector> result;
+      memcpy((char *)result.parts, &low, sizeof(low));
+      memcpy((char *)result.parts + sizeof(low), &high, sizeof(high));
+
+      return result;
+}
+
+// All ones in the lanes which are 0.
+template <typename Vector>
+inline __attribute__((always_inline)) RowLanes<Vector> getZeroLanes(const RowLanes<Vector> &lanes) {
+      RowLanes<Vector> result;
+
+      for (int i = 0; i < RowLanes<Vector>::PARTS_COUNT; i++) result.parts[i] = (Vector)(lanes.parts[i] == 0);
+
+      return result;
+}
+
+// All ones in the lanes with exactly one bit set.
+template <typename Vector>
+inline __attribute__((always_inline)) RowLanes<Vector> getSingleBitLanes(const RowLanes<Vector> &lanes) {
+      RowLanes<Vector> result;
+
+      for (int i = 0; i < RowLanes<Vector>::PARTS_COUNT; i++) {
+            const Vector part = lanes.parts[i];
+
+            result.parts[i] = (Vector)((part & (part - 1)) == 0) & ~(Vector)(part == 0);
+      }
+
+      return result;
+}
+
+// Moves lane i + COUNT to lane i, filling the top lanes with 0. COUNT stays below a part's width.
+template <int COUNT, typename Vector>
+inline __attribute__((always_inline)) RowLanes<Vector> shiftLanesDown(const RowLanes<Vector> &lanes) {
+      RowLanes<Vector> result;
+
+      if constexpr (RowLanes<Vector>::WIDTH == 16) {
+            result.parts[0] = __builtin_shufflevector(lanes.parts[0], Vector{}, COUNT, COUNT + 1, COUNT + 2,
+                                                      COUNT + 3, COUNT + 4, COUNT + 5, COUNT + 6, COUNT + 7,
+                                                      COUNT + 8, COUNT + 9, COUNT + 10, COUNT + 11,
+                                                      COUNT + 12, COUNT + 13, COUNT + 14, COUNT + 15);
+      } else {
+            result.parts[0] = __builtin_shufflevector(lanes.parts[0], lanes.parts[1], COUNT, COUNT + 1,
+                                                      COUNT + 2, COUNT + 3, COUNT + 4, COUNT + 5, COUNT + 6,
+                                                      COUNT + 7);
+            result.parts[1] = __builtin_shufflevector(lanes.parts[1], Vector{}, COUNT, COUNT + 1, COUNT + 2,
+                                                      COUNT + 3, COUNT + 4, COUNT + 5, COUNT + 6, COUNT + 7);
+      }
+
+      return result;
+}
+
+template <typename Vector>
+inline __attribute__((always_inline)) bool isAnyLaneSet(const RowLanes<Vector> &lanes) {
+      uint64_t words[sizeof(RowLanes<Vector>) / sizeof(uint64_t)];
+      memcpy(words, lanes.parts, sizeof(words));
+
+      return (words[0] | words[1] | words[2] | words[3]) != 0;
+}
+
+template <typename Vector>
+inline __attribute__((always_inline)) uint16_t getLane(const RowLanes<Vector> &lanes, const int index) {
+      const int WIDTH = RowLanes<Vector>::WIDTH;
+
+      return lanes.parts[index / WIDTH][index % WIDTH];
+}
+
+template <typename Vector>
+inline __attribute__((always_inline)) void setLane(RowLanes<Vector> *lanes, const int index,
+                                                   const uint16_t value) {
+      const int WIDTH = RowLanes<Vector>::WIDTH;
+
+      lanes->parts[index / WIDTH][index % WIDTH] = value;
+}
+
+// The vector kernels need x86: SSE2 is part of x86-64 itself, AVX2 is checked on the CPU.
+bool isPropagationKernelSupported(const PropagationKernel kernel) {
+#if defined(__x86_64__)
+      __builtin_cpu_init();
+
+      return kernel != PropagationKernel::Avx2 || __builtin_cpu_supports("avx2");
+#else
+      return kernel == PropagationKernel::Scalar;
+#endif
+}
+
+PropagationKernel getBestPropagationKernel() {
+      for (int kernel = PROPAGATION_KERNELS_COUNT - 1; kernel > 0; kernel--)
+            if (isPropagationKernelSupported((PropagationKernel)kernel)) return (PropagationKernel)kernel;
+
+      return PropagationKernel::Scalar;
+}
+
+// "auto" picks the best kernel the CPU supports; a named one is accepted only if it's supported.
+bool parsePropagationKernel(const char *text, PropagationKernel *kernel) {
+      if (strcmp(text, "auto") == 0) {
+            *kernel = getBestPropagationKernel();
+
+            return true;
+      }
+
+      for (int i = 0; i < PROPAGATION_KERNELS_COUNT; i++) {
+            if (strcmp(text, PROPAGATION_KERNEL_NAMES[i]) == 0) {
+                  *kernel = (PropagationKernel)i;
+
+                  return isPropagationKernelSupported(*kernel);
+            }
+      }
+
+      return false;
+}
+
+// Every thread builds its matrix once and reuses it for all the puzzles it solves.
+DlxArena *getThreadDlxArena() {
+      thread_local DlxArena *arena = nullptr;
+
+      if (arena == nullptr) {
+            thread_local DlxArena storage;
+
+            initDlxArena(&storage);
+            arena = &storage;
+      }
+
+      return arena;
+}
+
+void initDlxArena(DlxArena *arena) {
+      const int ROOT = 0;
+
+      for (int col = 0; col <= DLX_COLUMNS_COUNT; col++) {
+            arena->left[col] = col == ROOT ? DLX_COLUMNS_COUNT : col - 1;
+            arena->right[col] = col == DLX_COLUMNS_COUNT ? ROOT : col + 1;
+            arena->up[col] = arena->down[col] = arena->column[col] = col;
+            arena->size[col] = 0;
+      }
+
+      for (int cell = 0; cell < BOARD_CELLS_COUNT; cell++) {
+            const int row = cell / BOARD_DIMENSION, col = cell % BOARD_DIMENSION;
+
+            for (int digit = 1; digit <= BOARD_DIMENSION; digit++) {
+                  const int first = getDlxRowNode(cell, digit);
+                  const int columns[DLX_CONSTRAINTS_COUNT] = {
+                      1 + cell,
+                      1 + BOARD_CELLS_COUNT + row * BOARD_DIMENSION + digit - 1,
+                      1 + 2 * BOARD_CELLS_COUNT + col * BOARD_DIMENSION + digit - 1,
+                      1 + 3 * BOARD_CELLS_COUNT + getSectionIndex(row, col) * BOARD_DIMENSION + digit - 1};
+
+                  for (int k = 0; k < DLX_CONSTRAINTS_COUNT; k++) {
+                        const int node = first + k, header = columns[k];
+
+                        arena->left[node] = k == 0 ? first + DLX_CONSTRAINTS_COUNT - 1 : node - 1;
+                        arena->right[node] = k == DLX_CONSTRAINTS_COUNT - 1 ? first : node + 1;
+
+                        arena->column[node] = header;
+                        arena->up[node] = arena->up[header];
+                        arena->down[node] = header;
+                        arena->down[arena->up[header]] = node;
+                        arena->up[header] = node;
+                        arena->size[header]++;
+                  }
+            }
+      }
+
+      arena->chosenCount = 0;
+}
+
+// Same contract as countSolutions. The arena is left exactly as it was before the call.
+int solveWithDlx(DlxArena *arena, const Board *puzzle, const int limit, Board *solution) {
+      const int HIDDEN_DIGIT = 0;
+
+      for (int unit = 0; unit < BOARD_DIMENSION; unit++) {
+            for (int kind = 0; kind < UNIT_KINDS_COUNT; kind++)
+                  if (puzzle->conflictMasks[kind][unit] != 0) return 0;
+      }
+
+      for (int cell = 0; cell < BOARD_CELLS_COUNT; cell++) {
+            if (puzzle->digits[cell] != HIDDEN_DIGIT)
+                  selectDlxRow(arena, getDlxRowNode(cell, puzzle->digits[cell]));
+      }
+
+      int solutionsCount = 0;
+      searchDlx(arena, limit, &solutionsCount, solution);
+
+      while (arena->chosenCount > 0) unselectDlxRow(arena, arena->chosenRows[arena->chosenCount - 1]);
+
+      return solutionsCount;
+}
+
+// Algorithm X: branches on the column with the fewest rows left.
+void searchDlx(DlxArena *arena, const int limit, int *solutionsCount, Board *solution) {
+      const int ROOT = 0;
+
+      if (arena->right[ROOT] == ROOT) {
+            if (*solutionsCount == 0 && solution != nullptr) {
+                  *solution = Board{};
+
+                  for (int i = 0; i < arena->chosenCount; i++) {
+                        const int rowIndex =
+                            (arena->chosenRows[i] - 1 - DLX_COLUMNS_COUNT) / DLX_CONSTRAINTS_COUNT;
+                        const int cell = rowIndex / BOARD_DIMENSION;
+
+                        setDigit(solution, cell, rowIndex % BOARD_DIMENSION + 1);
+                  }
+            }
+
+            (*solutionsCount)++;
+
+            return;
+      }
+
+      int bestCol = arena->right[ROOT];
+      for (int col = arena->right[bestCol]; col != ROOT && arena->size[bestCol] > 1; col = arena->right[col])
+            if (arena->size[col] < arena->size[bestCol]) bestCol = col;
+
+      if (arena->size[bestCol] == 0) return;
+
+      for (int node = arena->down[bestCol]; node != bestCol && *solutionsCount < limit;
+           node = arena->down[node]) {
+            selectDlxRow(arena, node);
+
+            searchDlx(arena, limit, solutionsCount, solution);
+
+            unselectDlxRow(arena, node);
+      }
+}
+
+void coverDlxColumn(DlxArena *arena, const int col) {
+      arena->right[arena->left[col]] = arena->right[col];
+      arena->left[arena->right[col]] = arena->left[col];
+
+      for (int i = arena->down[col]; i != col; i = arena->down[i]) {
+            for (int j = arena->right[i]; j != i; j = arena->right[j]) {
+                  arena->down[arena->up[j]] = arena->down[j];
+                  arena->up[arena->down[j]] = arena->up[j];
+                  arena->size[arena->column[j]]--;
+            }
+      }
+}
+
+void uncoverDlxColumn(DlxArena *arena, const int col) {
+      for (int i = arena->up[col]; i != col; i = arena->up[i]) {
+            for (int j = arena->left[i]; j != i; j = arena->left[j]) {
+                  arena->size[arena->column[j]]++;
+                  arena->down[arena->up[j]] = j;
+                  arena->up[arena->down[j]] = j;
+            }
+      }
+
+      arena->right[arena->left[col]] = col;
+      arena->left[arena->right[col]] = col;
+}
+
+// Takes the row of the node into the partial solution, covering all of its columns.
+void selectDlxRow(DlxArena *arena, const int node) {
+      arena->chosenRows[arena->chosenCount++] = node;
+
+      coverDlxColumn(arena, arena->column[node]);
+      for (int j = arena->right[node]; j != node; j = arena->right[j])
+            coverDlxColumn(arena, arena->column[j]);
+}
+
+void unselectDlxRow(DlxArena *arena, const int node) {
+      for (int j = arena->left[node]; j != node; j = arena->left[j])
+            uncoverDlxColumn(arena, arena->column[j]);
+      uncoverDlxColumn(arena, arena->column[node]);
+
+      arena->chosenCount--;
+}
+
+int getDlxRowNode(const int cell, const int digit) {
+      return 1 + DLX_COLUMNS_COUNT + DLX_CONSTRAINTS_COUNT * (cell * BOARD_DIMENSION + digit - 1);
+}
+
+Grade gradePuzzle(const Board *puzzle) {
+      GradingState state;
+      Grade grade = {0, 0, 0, false};
+
+      bool isProgressing = initGradingState(&state, puzzle);
+
+      while (isProgressing && state.hiddenCount > 0 && !state.isContradictory) {
+            isProgressing = false;
+
+            for (int technique = 0; !isProgressing && technique < TECHNIQUES_COUNT; technique++) {
+                  if (applyTechnique(&state, (Technique)technique)) {
+                        isProgressing = true;
+
+                        grade.stepsCount++;
+                        grade.usedTechniques |= 1 << technique;
+                        grade.rating = std::max(grade.rating, TECHNIQUE_COSTS[technique]);
+                  }
+            }
+      }
+
+      grade.isSolved = state.hiddenCount == 0 && !state.isContradictory;
+
+      if (!grade.isSolved) grade.rating = MAX_RATING;
+
+      return grade;
+}
+
+bool initGradingState(GradingState *state, const Board *puzzle) {
+      state->hiddenCount = 0;
+      state->isContradictory = false;
+
+      for (int cell = 0; cell < BOARD_CELLS_COUNT; cell++) {
+            state->digits[cell] = puzzle->digits[cell];
+            state->candidates[cell] = puzzle->digits[cell] == 0 ? getCandidatesMask(puzzle, cell) : 0;
+
+            if (puzzle->digits[cell] == 0) state->hiddenCount++;
+            if (puzzle->digits[cell] == 0 && state->candidates[cell] == 0) state->isContradictory = true;
+      }
+
+      for (int unit = 0; unit < BOARD_DIMENSION; unit++) {
+            for (int kind = 0; kind < UNIT_KINDS_COUNT; kind++)
+                  if (puzzle->conflictMasks[kind][unit] != 0) state->isContradictory = true;
+      }
+
+      return !state->isContradictory;
+}
+
+// Applies one pass of the technique and returns whether it placed or eliminated anything.
+bool applyTechnique(GradingState *state, const Technique technique) {
+      switch (technique) {
+            case Technique::HiddenSingle:
+                  return applyHiddenSingles(state);
+            case Technique::NakedSingle:
+                  return applyNakedSingles(state);
+            case Technique::LockedCandidates:
+                  return applyLockedCandidates(state);
+            case Technique::NakedPair:
+                  return applyNakedSubsets(state, 2);
+            case Technique::HiddenPair:
+                  return applyHiddenSubsets(state, 2);
+            case Technique::NakedTriple:
+                  return applyNakedSubsets(state, 3);
+            case Technique::XWing:
+                  return applyFish(state, 2);
+            case Technique::HiddenTriple:
+                  return applyHiddenSubsets(state, 3);
+            case Technique::Swordfish:
+                  return applyFish(state, 3);
+            default:
+                  return false;
+      }
+}
+
+// A digit with a single possible cell in a unit goes there.
+bool applyHiddenSingles(GradingState *state) {
+      bool isChanged = false;
+
+      for (int unit = 0; unit < UNITS_COUNT; unit++) {
+            uint16_t onceMask = 0, twiceMask = 0;
+
+            for (int i = 0; i < BOARD_DIMENSION; i++) {
+                  const uint16_t candidates = state->candidates[getUnitCell(unit, i)];
+
+                  twiceMask |= onceMask & candidates;
+                  onceMask |= candidates;
+            }
+
+            for (uint16_t singles = onceMask & ~twiceMask; singles != 0; singles &= singles - 1) {
+                  const uint16_t bit = singles & -singles;
+
+                  for (int i = 0; i < BOARD_DIMENSION; i++) {
+                        const int cell = getUnitCell(unit, i);
+
+                        if (state->candidates[cell] & bit) {
+                              placeGradingDigit(state, cell, __builtin_ctz(bit) + 1);
+                              isChanged = true;
+
+                              break;
+                        }
+                  }
+            }
+      }
+
+      return isChanged;
+}
+
+// A cell with a single candidate gets it.
+bool applyNakedSingles(GradingState *state) {
+      bool isChanged = false;
+
+      for (int cell = 0; cell < BOARD_CELLS_COUNT; cell++) {
+            const uint16_t candidates = state->candidates[cell];
+
+            if (candidates != 0 && (candidates & (candidates - 1)) == 0) {
+                  placeGradingDigit(state, cell, __builtin_ctz(candidates) + 1);
+                  isChanged = true;
+            }
+      }
+
+      return isChanged;
+}
+
+// Pointing: a digit confined to one line inside a section leaves the rest of that line. Claiming:
+// a digit confined to one section inside a line leaves the rest of that section.
+bool applyLockedCandidates(GradingState *state) {
+      const CellLayout<BOARD_SECTION_LEN> &layout = CELL_LAYOUT<BOARD_SECTION_LEN>;
+
+      bool isChanged = false;
+
+      for (int section = 0; section < BOARD_DIMENSION; section++) {
+            const int sectionUnit = SECTION_UNIT * BOARD_DIMENSION + section;
+
+            for (uint16_t bit = 1; bit & ALL_DIGITS_MASK; bit <<= 1) {
+                  uint16_t positions = getDigitPositions(state, sectionUnit, bit);
+
+                  if (positions == 0) continue;
+
+                  uint16_t rows = 0, cols = 0;
+                  for (uint16_t rest = positions; rest != 0; rest &= rest - 1) {
+                        const int cell = getUnitCell(sectionUnit, __builtin_ctz(rest));
+
+                        rows |= 1 << layout.cellRows[cell];
+                        cols |= 1 << layout.cellCols[cell];
+                  }
+
+                  const int row = __builtin_ctz(rows), col = __builtin_ctz(cols);
+                  const bool isInOneRow = (rows & (rows - 1)) == 0, isInOneCol = (cols & (cols - 1)) == 0;
+
+                  for (int i = 0; i < BOARD_DIMENSION; i++) {
+                        if (isInOneRow && getSectionIndex(row, i) != section)
+                              isChanged |= eliminateCandidates(state, row * BOARD_DIMENSION + i, bit);
+                        if (isInOneCol && getSectionIndex(i, col) != section)
+                              isChanged |= eliminateCandidates(state, i * BOARD_DIMENSION + col, bit);
+                  }
+            }
+      }
+
+      for (int lineUnit = 0; lineUnit < SECTION_UNIT * BOARD_DIMENSION; lineUnit++) {
+            for (uint16_t bit = 1; bit & ALL_DIGITS_MASK; bit <<= 1) {
+                  uint16_t positions = getDigitPositions(state, lineUnit, bit);
+
+                  if (positions == 0) continue;
+
+                  uint16_t sections = 0;
+                  for (uint16_t rest = positions; rest != 0; rest &= rest - 1) {
+                        const int cell = getUnitCell(lineUnit, __builtin_ctz(rest));
+
+                        sections |= 1 << layout.cellSections[cell];
+                  }
+
+                  if ((sections & (sections - 1)) != 0) continue;
+
+                  const int sectionUnit = SECTION_UNIT * BOARD_DIMENSION + __builtin_ctz(sections);
+
+                  for (int i = 0; i < BOARD_DIMENSION; i++) {
+                        const int cell = getUnitCell(sectionUnit, i);
+                        const bool isOnLine = lineUnit < BOARD_DIMENSION
+                                                  ? layout.cellRows[cell] == lineUnit
+                                                  : layout.cellCols[cell] == lineUnit - BOARD_DIMENSION;
+
+                        if (!isOnLine) isChanged |= eliminateCandidates(state, cell, bit);
+                  }
+            }
+      }
+
+      return isChanged;
+}
+
+// size hidden cells of a unit sharing exactly size candidates take those digits from the rest of it.
+bool applyNakedSubsets(GradingState *state, const int size) {
+      bool isChanged = false;
+
+      for (int unit = 0; unit < UNITS_COUNT; unit++) {
+            uint16_t hiddenPositions = 0;
+
+            for (int i = 0; i < BOARD_DIMENSION; i++)
+                  if (state->candidates[getUnitCell(unit, i)] != 0) hiddenPositions |= 1 << i;
+
+            if (__builtin_popcount(hiddenPositions) <= size) continue;
+
+            for (uint16_t subset = hiddenPositions; subset != 0; subset = (subset - 1) & hiddenPositions) {
+                  if (__builtin_popcount(subset) != size) continue;
+
+                  uint16_t digits = 0;
+                  for (uint16_t rest = subset; rest != 0; rest &= rest - 1)
+                        digits |= state->candidates[getUnitCell(unit, __builtin_ctz(rest))];
+
+                  if (__builtin_popcount(digits) != size) continue;
+
+                  for (uint16_t rest = hiddenPositions & ~subset; rest != 0; rest &= rest - 1) {
+                        const int cell = getUnitCell(unit, __builtin_ctz(rest));
+
+                        isChanged |= eliminateCandidates(state, cell, digits);
+                  }
+            }
+      }
+
+      return isChanged;
+}
+
+// size digits of a unit confined to exactly size cells leave no room for other candidates there.
+bool applyHiddenSubsets(GradingState *state, const int size) {
+      bool isChanged = false;
+
+      for (int unit = 0; unit < UNITS_COUNT; unit++) {
+            uint16_t positionsOfDigits[BOARD_DIMENSION];
+            uint16_t missingDigits = 0;
+
+            for (int digit = 0; digit < BOARD_DIMENSION; digit++) {
+                  positionsOfDigits[digit] = getDigitPositions(state, unit, 1 << digit);
+
+                  if (positionsOfDigits[digit] != 0) missingDigits |= 1 << digit;
+            }
+
+            if (__builtin_popcount(missingDigits) <= size) continue;
+
+            for (uint16_t subset = missingDigits; subset != 0; subset = (subset - 1) & missingDigits) {
+                  if (__builtin_popcount(subset) != size) continue;
+
+                  uint16_t positions = 0;
+                  for (uint16_t rest = subset; rest != 0; rest &= rest - 1)
+                        positions |= positionsOfDigits[__builtin_ctz(rest)];
+
+                  if (__builtin_popcount(positions) != size) continue;
+
+                  for (uint16_t rest = positions; rest != 0; rest &= rest - 1) {
+                        const int cell = getUnitCell(unit, __builtin_ctz(rest));
+
+                        isChanged |= eliminateCandidates(state, cell, ~subset);
+                  }
+            }
+      }
+
+      return isChanged;
+}
+
+// X-Wing (size 2) and Swordfish (size 3): if a digit's places in size rows all lie within size
+// columns, the digit leaves the other cells of those columns; same with rows and columns swapped.
+bool applyFish(GradingState *state, const int size) {
+      bool isChanged = false;
+
+      for (int baseKind = ROW_UNIT; baseKind <= COL_UNIT; baseKind++) {
+            const int coverKind = baseKind == ROW_UNIT ? COL_UNIT : ROW_UNIT;
+
+            for (uint16_t bit = 1; bit & ALL_DIGITS_MASK; bit <<= 1) {
+                  uint16_t positionsOfLines[BOARD_DIMENSION];
+                  uint16_t baseLines = 0;
+
+                  for (int line = 0; line < BOARD_DIMENSION; line++) {
+                        const int lineUnit = baseKind * BOARD_DIMENSION + line;
+
+                        positionsOfLines[line] = getDigitPositions(state, lineUnit, bit);
+
+                        const int count = __builtin_popcount(positionsOfLines[line]);
+
+                        if (count >= 2 && count <= size) baseLines |= 1 << line;
+                  }
+
+                  for (uint16_t subset = baseLines; subset != 0; subset = (subset - 1) & baseLines) {
+                        if (__builtin_popcount(subset) != size) continue;
+
+                        uint16_t coverLines = 0;
+                        for (uint16_t rest = subset; rest != 0; rest &= rest - 1)
+                              coverLines |= positionsOfLines[__builtin_ctz(rest)];
+
+                        if (__builtin_popcount(coverLines) != size) continue;
+
+                        for (uint16_t rest = coverLines; rest != 0; rest &= rest - 1) {
+                              const int coverUnit = coverKind * BOARD_DIMENSION + __builtin_ctz(rest);
+
+                              for (int i = 0; i < BOARD_DIMENSION; i++) {
+                                    if (subset & (1 << i)) continue;
+
+                                    isChanged |= eliminateCandidates(state, getUnitCell(coverUnit, i), bit);
+                              }
+                        }
+                  }
+            }
+      }
+
+      return isChanged;
+}
+
+void placeGradingDigit(GradingState *state, const int cell, const int digit) {
+      state->digits[cell] = digit;
+      state->candidates[cell] = 0;
+      state->hiddenCount--;
+
+      for (int peer : CELL_LAYOUT<BOARD_SECTION_LEN>.peerCells[cell]) {
+            if (state->digits[peer] == 0) eliminateCandidates(state, peer, getDigitBit(digit));
+      }
+}
+
+// Returns whether the cell lost any of the digits. Emptying a hidden cell marks the state as
+// contradictory.
+bool eliminateCandidates(GradingState *state, const int cell, const uint16_t digitsMask) {
+      const uint16_t candidates = state->candidates[cell];
+
+      if ((candidates & digitsMask) == 0) return false;
+
+      state->candidates[cell] = candidates & ~digitsMask;
+
+      if (state->candidates[cell] == 0) state->isContradictory = true;
+
+      return true;
+}
+
+// Mask of the indices within the unit where the digit is still a candidate.
+uint16_t getDigitPositions(const GradingState *state, const int unit, const uint16_t digitBit) {
+      uint16_t positions = 0;
+
+      for (int i = 0; i < BOARD_DIMENSION; i++)
+            if (state->candidates[getUnitCell(unit, i)] & digitBit) positions |= 1 << i;
+
+      return positions;
+}
+
+// Tries the grader's techniques, cheapest first, until a single shows up; the hint names the
+// hardest technique that was needed on the way.
+bool findLogicalStep(const Board *digits, Hint *hint) {
+      GradingState state;
+
+      if (!initGradingState(&state, digits)) return false;
+
+      int hardestTechnique = Technique::HiddenSingle;
+
+      for (;;) {
+            if (findSingle<BOARD_SECTION_LEN>(state.candidates, hint)) {
+                  hint->technique = std::max(hint->technique, hardestTechnique);
+
+                  return true;
+            }
+
+            bool isProgressing = false;
+
+            for (int technique = Technique::LockedCandidates; !isProgressing && technique < TECHNIQUES_COUNT;
+                 technique++) {
+                  if (applyTechnique(&state, (Technique)technique)) {
+                        isProgressing = true;
+                        hardestTechnique = std::max(hardestTechnique, technique);
+                  }
+            }
+
+            if (!isProgressing || state.isContradictory) return false;
+      }
+}
+
+const char *getHintStepName(const int technique) {
+      return technique == REVEALING_STEP ? REVEALING_STEP_NAME : TECHNIQUE_NAMES[technique];
+}
@@ -0,0 +1,307 @@
+// screen.cpp - frames of the game and their output to the terminal
+#include "sudoku.h"
+
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// Starts a new frame; the terminal keeps the previous one until presentScreen.
+void clearScreen(Screen *screen) {
+      screen->cells.clear();
+      screen->rowsCount = 0;
+      screen->row = screen->col = 0;
+}
+
+// Glyphs past SCREEN_WIDTH are dropped.
+void putGlyph(Screen *screen, const int fgColor, const int bgColor, const char glyph) {
+      const ScreenCell BLANK_CELL = {' ', Color::Default, Color::Default};
+
+      if (glyph == '\n') {
+            screen->row++;
+            screen->col = 0;
+
+            return;
+      }
+
+      if (screen->col == SCREEN_WIDTH) return;
+
+      if (screen->row >= screen->rowsCount) {
+            screen->rowsCount = screen->row + 1;
+            screen->cells.resize(screen->rowsCount * SCREEN_WIDTH, BLANK_CELL);
+      }
+
+      screen->cells[screen->row * SCREEN_WIDTH + screen->col] = {glyph, (uint8_t)fgColor, (uint8_t)bgColor};
+      screen->col++;
+}
+
+// Sends the terminal the cells of the frame which differ from the shown ones: a cursor move before
+// every run of changed cells, the colors only where they change, and an erase of the rest of a row
+// which got shorter. The first frame, and every frame the terminal has to scroll for, is drawn from
+// a cleared screen.
+void presentScreen(Screen *screen) {
+      const uint64_t startNs = startStatTimer();
+
+      composeScreenUpdate(screen, getTerminalRowsCount());
+      writeWholeBuffer(STDOUT_FILENO, screen->output.data(), screen->output.size());
+
+      stopStatTimer(StatHistogram::PresentTime, startNs);
+      recordStatValue(StatHistogram::FrameBytes, screen->output.size());
+      countStat(StatCounter::FramesPresented, 1);
+}
+
+// Fills the output of the screen with the escape sequences presentScreen sends, for a terminal of
+// terminalRowsCount rows, and takes the frame as shown.
+void composeScreenUpdate(Screen *screen, const int terminalRowsCount) {
+      const ScreenCell BLANK_CELL = {' ', Color::Default, Color::Default};
+      const char CLEAR_SCREEN[] = "\x1B[H\x1B[2J", CLEAR_LINE_TAIL[] = "\x1B[K";
+      const int UNKNOWN = -1;
+      const int SHORT_GAP_LEN = 4;
+
+      std::vector<char> *output = &screen->output;
+      const int rowsCount = std::max(screen->rowsCount, screen->shownRowsCount);
+
+      const bool isScrolling = rowsCount >= terminalRowsCount;
+
+      int cursorRow = UNKNOWN, cursorCol = UNKNOWN;
+      int fgColor = UNKNOWN, bgColor = UNKNOWN;
+
+      output->clear();
+      screen->shownCells.resize(rowsCount * SCREEN_WIDTH, BLANK_CELL);
+
+      if (!screen->isShown || isScrolling) {
+            output->insert(output->end(), CLEAR_SCREEN, CLEAR_SCREEN + strlen(CLEAR_SCREEN));
+            std::fill(screen->shownCells.begin(), screen->shownCells.end(), BLANK_CELL);
+
+            cursorRow = cursorCol = 0;
+            screen->isShown = true;
+      }
+
+      for (int row = 0; row < rowsCount; row++) {
+            ScreenCell *shownCells = &screen->shownCells[row * SCREEN_WIDTH];
+            const ScreenCell *cells = row < screen->rowsCount ? &screen->cells[row * SCREEN_WIDTH] : nullptr;
+            int width = 0;
+
+            for (int col = 0; cells != nullptr && col < SCREEN_WIDTH; col++)
+                  if (!isBlankScreenCell(cells[col])) width = col + 1;
+
+            for (int col = 0; col < width; col++) {
+                  const ScreenCell cell = cells[col];
+
+                  if (isSameScreenCell(cell, shownCells[col])) continue;
+
+                  // A few unchanged glyphs in the current colors are shorter than a cursor move.
+                  if (row == cursorRow && col > cursorCol && col - cursorCol <= SHORT_GAP_LEN) {
+                        bool isGapPlain = true;
+
+                        for (int gapCol = cursorCol; gapCol < col; gapCol++) {
+                              const ScreenCell gapCell = cells[gapCol];
+
+                              isGapPlain &= gapCell.bgColor == bgColor &&
+                                            (gapCell.glyph == ' ' || gapCell.fgColor == fgColor);
+                        }
+
+                        for (; isGapPlain && cursorCol < col; cursorCol++)
+                              output->push_back(cells[cursorCol].glyph);
+                  }
+
+                  if (row != cursorRow || col != cursorCol)
+                        appendCursorMove(output, row, col, cursorRow, isScrolling);
+                  if (cell.fgColor != fgColor || cell.bgColor != bgColor)
+                        appendColors(output, cell.fgColor, cell.bgColor);
+
+                  output->push_back(cell.glyph);
+                  shownCells[col] = cell;
+
+                  cursorRow = row, cursorCol = col + 1;
+                  fgColor = cell.fgColor, bgColor = cell.bgColor;
+            }
+
+            if (std::all_of(shownCells + width, shownCells + SCREEN_WIDTH, isBlankScreenCell)) continue;
+
+            // The erase fills with the current background.
+            if (row != cursorRow || width != cursorCol)
+                  appendCursorMove(output, row, width, cursorRow, isScrolling);
+            if (bgColor != Color::Default) {
+                  appendColors(output, Color::Default, Color::Default);
+                  fgColor = bgColor = Color::Default;
+            }
+
+            output->insert(output->end(), CLEAR_LINE_TAIL, CLEAR_LINE_TAIL + strlen(CLEAR_LINE_TAIL));
+            std::fill(shownCells + width, shownCells + SCREEN_WIDTH, BLANK_CELL);
+
+            cursorRow = row, cursorCol = width;
+      }
+
+      if (fgColor > Color::Default || bgColor > Color::Default)
+            appendColors(output, Color::Default, Color::Default);
+
+      if (screen->row != cursorRow || screen->col != cursorCol)
+            appendCursorMove(output, screen->row, screen->col, cursorRow, isScrolling);
+
+      screen->shownCells.resize(screen->rowsCount * SCREEN_WIDTH);
+      screen->shownRowsCount = screen->rowsCount;
+}
+
+bool isBlankScreenCell(const ScreenCell cell) { return cell.glyph == ' ' && cell.bgColor == Color::Default; }
+
+bool isSameScreenCell(const ScreenCell first, const ScreenCell second) {
+      if (first.glyph != second.glyph || first.bgColor != second.bgColor) return false;
+
+      return first.glyph == ' ' || first.fgColor == second.fgColor;
+}
+
+// Rows count from the top of the terminal, unless the frame is taller than the terminal and scrolls
+// it: then the cursor moves down by new lines and up by rows from its own.
+void appendCursorMove(std::vector<char> *output, const int row, const int col, const int cursorRow,
+                      const bool isScrolling) {
+      char sequence[24];
+      int length;
+
+      if (!isScrolling) {
+            length = snprintf(sequence, sizeof(sequence), "\x1B[%d;%dH", row + 1, col + 1);
+      } else if (row < cursorRow) {
+            length = snprintf(sequence, sizeof(sequence), "\x1B[%dA\x1B[%dG", cursorRow - row, col + 1);
+      } else {
+            for (int i = cursorRow; i < row; i++) output->insert(output->end(), {'\r', '\n'});
+
+            length = snprintf(sequence, sizeof(sequence), "\x1B[%dG", col + 1);
+      }
+
+      output->insert(output->end(), sequence, sequence + length);
+}
+
+// Resets the attributes first, so a default color needs no code of its own.
+void appendColors(std::vector<char> *output, const int fgColor, const int bgColor) {
+      const int SEQUENCE_SIZE = 24;
+
+      char sequence[SEQUENCE_SIZE];
+      int length = snprintf(sequence, SEQUENCE_SIZE, "\x1B[0");
+
+      if (bgColor != Color::Default)
+            length += snprintf(sequence + length, SEQUENCE_SIZE - length, ";%d", bgColor);
+      if (fgColor != Color::Default)
+            length += snprintf(sequence + length, SEQUENCE_SIZE - length, ";%d", fgColor);
+
+      sequence[length++] = 'm';
+      output->insert(output->end(), sequence, sequence + length);
+}
+
+// INT_MAX when the output isn't a terminal.
+int getTerminalRowsCount() {
+      winsize size{};
+
+      if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == -1 || size.ws_row == 0) return INT_MAX;
+
+      return size.ws_row;
+}
+
+void writeWholeBuffer(int fd, const char *data, const size_t size) {
+      size_t offset = 0;
+
+      while (offset < size) {
+            ssize_t writtenCount = write(fd, data + offset, size - offset);
+
+            if (writtenCount == -1 && errno == EINTR) continue;
+            if (writtenCount <= 0) return;
+
+            offset += writtenCount;
+      }
+}
+
+void showRules(Screen *screen, const int dimension, const int sectionLen) {
+      const Color TEXT = Color::Default;
+
+      putText(screen, TEXT, TEXT, "Rules of the game \"Sudoku\":\n");
+
+      putText(screen, TEXT, TEXT, "------------------------------\n");
+
+      putText(screen, TEXT, TEXT, "- Sudoku is played over a ");
+      putText(screen, TEXT, TEXT, dimension);
+      putGlyph(screen, TEXT, TEXT, 'x');
+      putText(screen, TEXT, TEXT, dimension);
+      putText(screen, TEXT, TEXT, " grid, divided \nto ");
+      putText(screen, TEXT, TEXT, sectionLen);
+      putGlyph(screen, TEXT, TEXT, 'x');
+      putText(screen, TEXT, TEXT, sectionLen);
+      putText(screen, TEXT, TEXT, " sub grids called \"regions\";\n");
+      putText(screen, TEXT, TEXT, "- Sudoku begins with some of the grid cells \n");
+      putText(screen, TEXT, TEXT, "already filled with numbers;\n");
+      putText(screen, TEXT, TEXT, "- The object of Sudoku is to fill the other \n");
+      putText(screen, TEXT, TEXT, "empty cells with numbers between 1 and ");
+      putGlyph(screen, TEXT, TEXT, getDigitChar(dimension));
+      putText(screen, TEXT, TEXT, " \naccording the following guidelines:\n");
+
+      putText(screen, TEXT, TEXT, "1. Number can appear only once on each row;\n");
+      putText(screen, TEXT, TEXT, "2. Number can appear only once on each column;\n");
+      putText(screen, TEXT, TEXT, "3. Number can appear only once on each region;\n\n");
+
+      putText(screen, TEXT, TEXT, "Note: you can't change the ");
+      putText(screen, Color::YellowFg, TEXT, "generated");
+      putText(screen, TEXT, TEXT, " digit;\n");
+
+      putText(screen, TEXT, TEXT, "------------------------------\n\n");
+}
+
+void showMenu(Screen *screen, const int countOfCorrectDigitsShown, const int dimension,
+              const uint64_t pooledFieldsCount, const uint64_t generatedFieldsCount) {
+      const Color TEXT = Color::Default;
+      const int END_COUNT = dimension * dimension;
+      const int MAX_DECIMAL_DIGIT = 9;
+
+      putText(screen, TEXT, TEXT, "\nm - show menu;\n");
+      putText(screen, TEXT, TEXT, "c - close menu;\n");
+      putText(screen, TEXT, TEXT, "Esc - close the game;\n\n");
+
+      putText(screen, TEXT, TEXT, "n - create new field;\n");
+      putText(screen, TEXT, TEXT, "r - reset all changes;\n");
+      putText(screen, TEXT, TEXT, "h - show hint;\n\n");
+
+      putText(screen, TEXT, TEXT, "w,a,s,d or arrows - moving;\n");
+      if (dimension <= MAX_DECIMAL_DIGIT) {
+            putText(screen, TEXT, TEXT, "1,2...");
+            putText(screen, TEXT, TEXT, dimension);
+      } else {
+            putText(screen, TEXT, TEXT, "1,2...9,A...");
+            putGlyph(screen, TEXT, TEXT, getDigitChar(dimension));
+      }
+      putText(screen, TEXT, TEXT, " - press if you want to change the cell;\n");
+      putText(screen, TEXT, TEXT, "0 - press if you want to clear inputed digit;\n\n");
+
+      putText(screen, TEXT, TEXT, "Remains to be filled out: ");
+      putText(screen, Color::YellowFg, TEXT, END_COUNT - countOfCorrectDigitsShown);
+      putText(screen, TEXT, TEXT, ";\n");
+      putText(screen, TEXT, TEXT, "Filled in: ");
+      putText(screen, Color::YellowFg, TEXT, countOfCorrectDigitsShown);
+      putText(screen, TEXT, TEXT, ";\n");
+      putText(screen, TEXT, TEXT, "New fields ready at once: ");
+      putText(screen, Color::YellowFg, TEXT, pooledFieldsCount);
+      putText(screen, TEXT, TEXT, ", generated on demand: ");
+      putText(screen, Color::YellowFg, TEXT, generatedFieldsCount);
+      putText(screen, TEXT, TEXT, ";\n\n");
+
+      putText(screen, TEXT, TEXT, "Field info: \n");
+      putGlyph(screen, Color::CyanFg, TEXT, '*');
+      putText(screen, TEXT, TEXT, " or ");
+      putGlyph(screen, Color::CyanFg, TEXT, '9');
+      putText(screen, TEXT, TEXT, " - current player position;\n");
+      putGlyph(screen, Color::BlackFg, TEXT, '*');
+      putText(screen, TEXT, TEXT, " - empty cell;\n");
+      putGlyph(screen, Color::YellowFg, TEXT, '9');
+      putText(screen, TEXT, TEXT, " - generated digit;\n");
+      putGlyph(screen, Color::RedFg, TEXT, '9');
+      putText(screen, TEXT, TEXT, " - incorrect digit;\n");
+      putGlyph(screen, Color::GreenFg, TEXT, '9');
+      putText(screen, TEXT, TEXT, " - correct digit;\n");
+}
+
+void showEndOfGame(Screen *screen, const int filledSellsCount) {
+      clearScreen(screen);
+
+      putText(screen, Color::GreenFg, Color::Default, "Congratulations!");
+      putText(screen, Color::Default, Color::Default, " You have completed ");
+      putText(screen, Color::CyanFg, Color::Default, "Sudoku");
+      putText(screen, Color::Default, Color::Default, " and filled ");
+      putText(screen, Color::MagentaFg, Color::Default, filledSellsCount);
+      putText(screen, Color::Default, Color::Default, " empty cells!");
+
+      presentScreen(screen);
+}
@@ -0,0 +1,745 @@
+// server.cpp - serve: many headless games at once over a Unix domain socket
+#include "sudoku.h"
+
+#include <csignal>
+#include <deque>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using BoardSession = GameSession<BOARD_SECTION_LEN>;
+
+const uint32_t SESSION_CHUNK_SIZE = 1024;
+const uint64_t FIRST_SESSION_STREAM = 2;  // 0 is the terminal game's, 1 the pools'
+const int MAX_EPOLL_EVENTS = 256;
+const int SERVER_READ_SIZE = 4096;
+const size_t MAX_PENDING_INPUT_SIZE = 1 << 16;
+const int SERVER_REPLY_SIZE = 128;
+
+// Sessions in chunks of SESSION_CHUNK_SIZE, allocated as the connections grow and freed only when the
+// server stops, so a worker keeps the address of its session while the event loop takes new
+// connections. The slot freed last is taken first, while its cache lines may still be warm. Used by
+// the event loop alone.
+struct SessionArena {
+      std::vector<BoardSession *> chunks;
+      std::vector<uint32_t> freeSlots;
+      uint32_t slotsCount;
+};
+
+enum ServerCommandKind { ActionCommand, HintCommand, ShowCommand };
+
+// One line of a client, parsed.
+struct ServerCommand {
+      ServerCommandKind kind;
+      SessionAction action;
+      int digit;
+};
+
+// A client is one session, kept by its socket. Its commands run one at a time and in order: while a
+// worker has one, the lines after it wait in input.
+struct ServerConnection {
+      int fd;
+      uint32_t sessionSlot;
+      BoardSession *session;
+      uint64_t sessionStream;
+      uint32_t events;     // the ones epoll waits for
+      bool isWatched;      // the socket is in epoll
+      bool isStarted;      // the first command gives the session its first field
+      bool isBusy;         // a worker has its command
+      bool isInputClosed;  // the client sent all its commands
+      bool isBroken;       // the socket failed; closed as soon as no worker has its command
+      std::vector<char> input, output;
+      size_t outputOffset;
+};
+
+// Command of a connection on its way to a worker, and its reply on the way back.
+struct ServerJob {
+      int fd;
+      BoardSession *session;
+      uint64_t sessionStream;
+      bool isStarting;
+      ServerCommand command;
+      char reply[SERVER_REPLY_SIZE];
+      int replyLength;
+};
+
+// The event loop owns the socket, the connections and the arena. Commands which need a new field or
+// a hint go to the workers through jobs and come back through doneJobs, and doneFd wakes the loop.
+struct Server {
+      const ServeOptions *options;
+      const PuzzleDb *db;
+      int epollFd, listenFd, doneFd, signalFd;
+      bool isAccepting;
+      SessionArena arena;
+      std::vector<ServerConnection> connections;  // by socket
+      int sessionsCount;
+      uint64_t servedSessionsCount, commandsCount;
+
+      std::mutex jobsMutex;
+      std::condition_variable jobReady;
+      std::deque<ServerJob> jobs;
+      bool isStopping;
+
+      std::mutex doneMutex;
+      std::vector<ServerJob> doneJobs;
+};
+
+bool openServerSocket(const char *path, int *listenFd);
+void runServerLoop(Server *server);
+void acceptConnections(Server *server);
+void setAccepting(Server *server, const bool isAccepting);
+void readConnection(Server *server, ServerConnection *connection);
+void dispatchCommands(Server *server, ServerConnection *connection);
+bool parseServerCommand(const char *line, const int length, ServerCommand *command);
+bool isCommandText(const char *line, const int length, const char *text);
+void runServerJob(Server *server, ServerJob *job, PuzzlePool<BOARD_SECTION_LEN> *pool);
+int formatSessionReply(const BoardSession *session, char *reply);
+int formatHintReply(const Hint *hint, char *reply);
+void serveJobsInWorker(Server *server, PuzzlePool<BOARD_SECTION_LEN> *pool);
+void finishDoneJobs(Server *server);
+void appendReply(ServerConnection *connection, const char *reply, const int length);
+void flushConnection(Server *server, ServerConnection *connection);
+void updateConnectionEvents(Server *server, ServerConnection *connection);
+void closeConnectionIfDone(Server *server, ServerConnection *connection);
+void closeConnection(Server *server, ServerConnection *connection);
+BoardSession *allocateSession(SessionArena *arena, uint32_t *slot);
+void freeSession(SessionArena *arena, const uint32_t slot);
+void freeSessionArena(SessionArena *arena);
+
+// A connection is a game: the first command gives it a field, generated from (seed, stream) where
+// the stream is the number of the connection, and every command answers with one line.
+int runServeMode(int argc, char *argv[]) {
+      ServeOptions options;
+
+      if (!parseServeOptions(argc, argv, &options)) {
+            std::cerr << "Usage: sudoku serve --socket PATH [--threads N] [--max-sessions N] [--seed N]\n"
+                         "                    [--db FILE] [--stats] [--trace FILE]\n"
+                         "Hosts a game of 9x9 per connection to the Unix domain socket PATH. Every line a\n"
+                         "client sends is a command and gets a line back:\n"
+                         "  move up|down|left|right, set D, clear, reset, new, show\n"
+                         "      -> ok ROW COL CORRECT FIELD: the cursor, the count of correct digits shown\n"
+                         "         and the 81 cells, '.' for hidden ones\n"
+                         "  hint -> hint ROW COL DIGIT STEP MISTAKES, or hint solved; the cursor moves\n"
+                         "         to the cell\n"
+                         "  anything else -> error ...\n"
+                         "New fields and hints are made by --threads workers, every one with a pool of\n"
+                         "fields generated ahead; the other commands are answered by the event loop.\n"
+                         "Past --max-sessions connections the server stops accepting until one closes.\n"
+                         "SIGINT or SIGTERM stop the server.\n";
+
+            return 1;
+      }
+
+      enableStats(options.statsMode);
+
+      PuzzleDb db{};
+
+      if (options.dbPath != nullptr && !openPuzzleDb(options.dbPath, &db)) {
+            std::cerr << "Can't read " << options.dbPath << " as a puzzle database." << std::endl;
+
+            return 1;
+      }
+
+      // Stop signals are read from signalFd by the loop, so no thread may take them: every thread
+      // started from here on inherits the mask.
+      sigset_t stopSignals;
+      sigemptyset(&stopSignals);
+      sigaddset(&stopSignals, SIGINT);
+      sigaddset(&stopSignals, SIGTERM);
+      pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+
+      raiseOpenFilesLimit();
+
+      Server server;
+      server.options = &options;
+      server.db = options.dbPath == nullptr ? nullptr : &db;
+      server.epollFd = epoll_create1(EPOLL_CLOEXEC);
+      server.doneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      server.signalFd = signalfd(-1, &stopSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+      server.isAccepting = true;
+      server.arena = SessionArena{};
+      server.sessionsCount = 0;
+      server.servedSessionsCount = server.commandsCount = 0;
+      server.isStopping = false;
+
+      if (server.epollFd == -1 || server.doneFd == -1 || server.signalFd == -1 ||
+          !openServerSocket(options.socketPath, &server.listenFd)) {
+            std::cerr << "Can't listen on " << options.socketPath << ": " << strerror(errno) << "."
+                      << std::endl;
+
+            return 1;
+      }
+
+      const int LOOP_FDS[] = {server.listenFd, server.doneFd, server.signalFd};
+
+      for (int fd : LOOP_FDS) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            epoll_ctl(server.epollFd, EPOLL_CTL_ADD, fd, &event);
+      }
+
+      // Every worker is the single consumer of its own pool. A database has the puzzles at hand
+      // already, so the pools get no difficulties and no threads.
+      std::vector<PuzzlePool<BOARD_SECTION_LEN>> pools(options.threadsCount);
+      std::vector<std::thread> workers;
+
+      for (int i = 0; i < options.threadsCount; i++) {
+            startPuzzlePool(&pools[i], options.seed + i,
+                            options.dbPath == nullptr ? 1 << Difficulty::Medium : 0);
+            workers.emplace_back(serveJobsInWorker, &server, &pools[i]);
+      }
+
+      std::cerr << "Serving on " << options.socketPath << " with " << options.threadsCount << " workers."
+                << std::endl;
+
+      runServerLoop(&server);
+
+      {
+            std::lock_guard<std::mutex> lock(server.jobsMutex);
+            server.isStopping = true;
+      }
+
+      server.jobReady.notify_all();
+
+      for (std::thread &worker : workers) worker.join();
+      for (PuzzlePool<BOARD_SECTION_LEN> &pool : pools) stopPuzzlePool(&pool);
+
+      for (ServerConnection &connection : server.connections)
+            if (connection.fd != -1) close(connection.fd);
+
+      close(server.listenFd);
+      unlink(options.socketPath);
+      close(server.signalFd);
+      close(server.doneFd);
+      close(server.epollFd);
+      freeSessionArena(&server.arena);
+
+      if (options.dbPath != nullptr) closePuzzleDb(&db);
+
+      std::cerr << "Served " << server.servedSessionsCount << " sessions and " << server.commandsCount
+                << " commands." << std::endl;
+
+      return finishStats(options.tracePath) ? 0 : 1;
+}
+
+bool parseServeOptions(int argc, char *argv[], ServeOptions *options) {
+      const uint64_t MAX_THREADS_COUNT = 1024;
+      const uint64_t MAX_SESSIONS_COUNT = 1 << 24;
+
+      uint64_t threadsCount = std::thread::hardware_concurrency();
+      uint64_t maxSessionsCount = 1 << 16;
+
+      options->socketPath = nullptr;
+      options->dbPath = nullptr;
+      options->tracePath = nullptr;
+      options->seed = time(nullptr);
+      options->statsMode = 0;
+
+      for (int i = 1; i < argc; i++) {
+            bool hasValue = i + 1 < argc;
+            bool isParsed = true;
+
+            if (strcmp(argv[i], "--socket") == 0 && hasValue)
+                  options->socketPath = argv[++i];
+            else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+                  isParsed = parseUnsignedOption(argv[++i], &threadsCount);
+            else if (strcmp(argv[i], "--max-sessions") == 0 && hasValue)
+                  isParsed = parseUnsignedOption(argv[++i], &maxSessionsCount) && maxSessionsCount > 0;
+            else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+                  isParsed = parseUnsignedOption(argv[++i], &options->seed);
+            else if (strcmp(argv[i], "--db") == 0 && hasValue)
+                  options->dbPath = argv[++i];
+            else if (strcmp(argv[i], "--stats") == 0)
+                  options->statsMode |= STATS_REPORTED;
+            else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+                  options->tracePath = argv[++i];
+            else
+                  isParsed = false;
+
+            if (!isParsed) return false;
+      }
+
+      options->threadsCount = threadsCount == 0 ? 1 : std::min(threadsCount, MAX_THREADS_COUNT);
+      options->maxSessionsCount = std::min(maxSessionsCount, MAX_SESSIONS_COUNT);
+
+      if (options->tracePath != nullptr) options->statsMode |= STATS_TRACED;
+
+      return options->socketPath != nullptr;
+}
+
+// A socket file left by a server which didn't stop cleanly is replaced; any other file is not.
+bool openServerSocket(const char *path, int *listenFd) {
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+
+      if (strlen(path) >= sizeof(address.sun_path)) {
+            errno = ENAMETOOLONG;
+
+            return false;
+      }
+
+      strcpy(address.sun_path, path);
+
+      struct stat status;
+
+      if (lstat(path, &status) == 0 && S_ISSOCK(status.st_mode)) unlink(path);
+
+      *listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+      if (*listenFd == -1) return false;
+
+      if (bind(*listenFd, (const sockaddr *)&address, sizeof(address)) == -1 ||
+          listen(*listenFd, SOMAXCONN) == -1) {
+            const int error = errno;
+
+            close(*listenFd);
+            errno = error;
+
+            return false;
+      }
+
+      return true;
+}
+
+// Every connection is a socket, so the soft limit of open files goes up to the hard one.
+void raiseOpenFilesLimit() {
+      rlimit limit;
+
+      if (getrlimit(RLIMIT_NOFILE, &limit) == -1 || limit.rlim_cur == limit.rlim_max) return;
+
+      limit.rlim_cur = limit.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+void runServerLoop(Server *server) {
+      epoll_event events[MAX_EPOLL_EVENTS];
+
+      for (;;) {
+            const int eventsCount = epoll_wait(server->epollFd, events, MAX_EPOLL_EVENTS, -1);
+
+            if (eventsCount == -1 && errno != EINTR) return;
+
+            for (int i = 0; i < eventsCount; i++) {
+                  const int fd = events[i].data.fd;
+
+                  if (fd == server->signalFd) return;
+
+                  if (fd == server->listenFd) {
+                        acceptConnections(server);
+                  } else if (fd == server->doneFd) {
+                        finishDoneJobs(server);
+                  } else {
+                        ServerConnection *connection = &server->connections[fd];
+
+                        if (connection->fd == -1) continue;
+
+                        if (events[i].events & (EPOLLERR | EPOLLHUP)) connection->isBroken = true;
+                        if (!connection->isBroken && (events[i].events & EPOLLIN))
+                              readConnection(server, connection);
+                        if (!connection->isBroken && (events[i].events & EPOLLOUT))
+                              flushConnection(server, connection);
+
+                        closeConnectionIfDone(server, connection);
+                  }
+            }
+      }
+}
+
+// Takes the connections waiting for the server, up to --max-sessions; past it, or out of sockets, the
+// rest wait in the backlog until a connection closes.
+void acceptConnections(Server *server) {
+      while (server->sessionsCount < server->options->maxSessionsCount) {
+            const int fd = accept4(server->listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+            if (fd == -1) {
+                  if (errno == EMFILE || errno == ENFILE) setAccepting(server, false);
+
+                  return;
+            }
+
+            if ((size_t)fd >= server->connections.size()) {
+                  ServerConnection unused{};
+                  unused.fd = -1;
+
+                  server->connections.resize(std::max<size_t>(fd + 1, server->connections.size() * 2),
+                                             unused);
+            }
+
+            ServerConnection *connection = &server->connections[fd];
+            connection->fd = fd;
+            connection->session = allocateSession(&server->arena, &connection->sessionSlot);
+            connection->sessionStream = FIRST_SESSION_STREAM + server->servedSessionsCount;
+            connection->events = EPOLLIN;
+            connection->isWatched = true;
+            connection->isStarted = connection->isBusy = false;
+            connection->isInputClosed = connection->isBroken = false;
+            connection->input.clear();
+            connection->output.clear();
+            connection->outputOffset = 0;
+
+            epoll_event event{};
+            event.events = connection->events;
+            event.data.fd = fd;
+            epoll_ctl(server->epollFd, EPOLL_CTL_ADD, fd, &event);
+
+            server->sessionsCount++;
+            server->servedSessionsCount++;
+            countStat(StatCounter::ServerSessions, 1);
+      }
+
+      setAccepting(server, false);
+}
+
+void setAccepting(Server *server, const bool isAccepting) {
+      if (server->isAccepting == isAccepting) return;
+
+      epoll_event event{};
+      event.events = isAccepting ? (uint32_t)EPOLLIN : 0u;
+      event.data.fd = server->listenFd;
+      epoll_ctl(server->epollFd, EPOLL_CTL_MOD, server->listenFd, &event);
+
+      server->isAccepting = isAccepting;
+}
+
+// A client which sends far more than its commands need is dropped.
+void readConnection(Server *server, ServerConnection *connection) {
+      char buffer[SERVER_READ_SIZE];
+
+      for (;;) {
+            const ssize_t readCount = read(connection->fd, buffer, sizeof(buffer));
+
+            if (readCount > 0) {
+                  connection->input.insert(connection->input.end(), buffer, buffer + readCount);
+
+                  if (connection->input.size() > MAX_PENDING_INPUT_SIZE) connection->isBroken = true;
+                  if (connection->isBroken || readCount < (ssize_t)sizeof(buffer)) break;
+            } else {
+                  if (readCount == 0)
+                        connection->isInputClosed = true;
+                  else if (errno != EAGAIN && errno != EINTR)
+                        connection->isBroken = true;
+
+                  break;
+            }
+      }
+
+      if (!connection->isBroken) dispatchCommands(server, connection);
+}
+
+// Runs the complete lines of the input until one goes to a worker. The cheap commands are answered
+// right here, which is most of them; a session's first command, new and hint are not.
+void dispatchCommands(Server *server, ServerConnection *connection) {
+      const char UNKNOWN_COMMAND_REPLY[] = "error unknown command\n";
+
+      size_t lineStart = 0;
+
+      while (!connection->isBusy && lineStart < connection->input.size()) {
+            const char *begin = connection->input.data() + lineStart;
+            const char *end = (const char *)memchr(begin, '\n', connection->input.size() - lineStart);
+
+            if (end == nullptr) break;
+
+            const int length = end - begin;
+            lineStart += length + 1;
+
+            const int commandLength = length > 0 && end[-1] == '\r' ? length - 1 : length;
+
+            ServerJob job;
+
+            if (!parseServerCommand(begin, commandLength, &job.command)) {
+                  appendReply(connection, UNKNOWN_COMMAND_REPLY, strlen(UNKNOWN_COMMAND_REPLY));
+                  continue;
+            }
+
+            job.fd = connection->fd;
+            job.session = connection->session;
+            job.sessionStream = connection->sessionStream;
+            job.isStarting = !connection->isStarted;
+
+            connection->isStarted = true;
+            server->commandsCount++;
+
+            if (!job.isStarting && job.command.kind != ServerCommandKind::HintCommand &&
+                job.command.action != SessionAction::NewField) {
+                  runServerJob(server, &job, nullptr);
+                  appendReply(connection, job.reply, job.replyLength);
+                  continue;
+            }
+
+            connection->isBusy = true;
+
+            {
+                  std::lock_guard<std::mutex> lock(server->jobsMutex);
+                  server->jobs.push_back(job);
+            }
+
+            server->jobReady.notify_one();
+      }
+
+      connection->input.erase(connection->input.begin(), connection->input.begin() + lineStart);
+
+      if (connection->isInputClosed && !connection->isBusy) connection->input.clear();
+
+      flushConnection(server, connection);
+}
+
+bool parseServerCommand(const char *line, const int length, ServerCommand *command) {
+      const char *const MOVE_COMMANDS[] = {"move up", "move down", "move left", "move right"};
+      const SessionAction MOVE_ACTIONS[] = {SessionAction::MoveUp, SessionAction::MoveDown,
+                                            SessionAction::MoveLeft, SessionAction::MoveRight};
+      const char SET_COMMAND[] = "set ";
+      const int SET_COMMAND_LEN = strlen(SET_COMMAND);
+
+      command->kind = ServerCommandKind::ActionCommand;
+      command->digit = 0;
+
+      for (int i = 0; i < 4; i++) {
+            if (isCommandText(line, length, MOVE_COMMANDS[i])) {
+                  command->action = MOVE_ACTIONS[i];
+
+                  return true;
+            }
+      }
+
+      if (length == SET_COMMAND_LEN + 1 && memcmp(line, SET_COMMAND, SET_COMMAND_LEN) == 0) {
+            command->action = SessionAction::PutDigit;
+            command->digit = getCharDigit(line[SET_COMMAND_LEN]);
+
+            return command->digit != 0 && command->digit <= BOARD_DIMENSION;
+      }
+
+      if (isCommandText(line, length, "clear"))
+            command->action = SessionAction::ClearDigit;
+      else if (isCommandText(line, length, "reset"))
+            command->action = SessionAction::ResetField;
+      else if (isCommandText(line, length, "new"))
+            command->action = SessionAction::NewField;
+      else if (isCommandText(line, length, "hint"))
+            command->kind = ServerCommandKind::HintCommand;
+      else if (isCommandText(line, length, "show"))
+            command->kind = ServerCommandKind::ShowCommand;
+      else
+            return false;
+
+      return true;
+}
+
+bool isCommandText(const char *line, const int length, const char *text) {
+      return length == (int)strlen(text) && memcmp(line, text, length) == 0;
+}
+
+// pool is the one of the worker running the job, nullptr on the event loop.
+void runServerJob(Server *server, ServerJob *job, PuzzlePool<BOARD_SECTION_LEN> *pool) {
+      const uint64_t startNs = startStatTimer();
+
+      BoardSession *session = job->session;
+
+      if (job->isStarting) startGameSession(session, server->options->seed, job->sessionStream, server->db);
+
+      if (job->command.kind == ServerCommandKind::HintCommand) {
+            Hint hint;
+            takeSessionHint(session, &hint);
+
+            job->replyLength = formatHintReply(&hint, job->reply);
+      } else {
+            if (job->command.kind == ServerCommandKind::ActionCommand)
+                  doSessionAction(session, job->command.action, job->command.digit, server->db, pool);
+
+            job->replyLength = formatSessionReply(session, job->reply);
+      }
+
+      stopStatTimer(StatHistogram::CommandTime, startNs);
+      countStat(StatCounter::ServerCommands, 1);
+}
+
+int formatSessionReply(const BoardSession *session, char *reply) {
+      int length = snprintf(reply, SERVER_REPLY_SIZE, "ok %d %d %d ", session->playerPosY + 1,
+                            session->playerPosX + 1, session->progress.correctDigitsCount);
+
+      for (int cell = 0; cell < BOARD_CELLS_COUNT; cell++) {
+            const int digit = session->currentDigits.digits[cell];
+
+            reply[length++] = digit == 0 ? '.' : getDigitChar(digit);
+      }
+
+      reply[length++] = '\n';
+
+      return length;
+}
+
+int formatHintReply(const Hint *hint, char *reply) {
+      if (hint->cell == -1) return snprintf(reply, SERVER_REPLY_SIZE, "hint solved\n");
+
+      return snprintf(reply, SERVER_REPLY_SIZE, "hint %d %d %d %s %d\n", hint->cell / BOARD_DIMENSION + 1,
+                      hint->cell % BOARD_DIMENSION + 1, hint->digit, getHintStepName(hint->technique),
+                      hint->mistakesCount);
+}
+
+// Only the first of a batch of finished jobs writes doneFd; the loop reads doneFd before it takes the
+// batch, so no job is left behind without a wake-up.
+void serveJobsInWorker(Server *server, PuzzlePool<BOARD_SECTION_LEN> *pool) {
+      const uint64_t WAKE_UP = 1;
+
+      for (;;) {
+            ServerJob job;
+
+            {
+                  std::unique_lock<std::mutex> lock(server->jobsMutex);
+
+                  while (!server->isStopping && server->jobs.empty()) server->jobReady.wait(lock);
+
+                  if (server->isStopping) return;
+
+                  job = server->jobs.front();
+                  server->jobs.pop_front();
+            }
+
+            runServerJob(server, &job, pool);
+
+            bool isFirstDone;
+
+            {
+                  std::lock_guard<std::mutex> lock(server->doneMutex);
+                  isFirstDone = server->doneJobs.empty();
+                  server->doneJobs.push_back(job);
+            }
+
+            if (isFirstDone) write(server->doneFd, &WAKE_UP, sizeof(WAKE_UP));
+      }
+}
+
+void finishDoneJobs(Server *server) {
+      uint64_t wakeUpsCount;
+      std::vector<ServerJob> doneJobs;
+
+      read(server->doneFd, &wakeUpsCount, sizeof(wakeUpsCount));
+
+      {
+            std::lock_guard<std::mutex> lock(server->doneMutex);
+            doneJobs.swap(server->doneJobs);
+      }
+
+      for (const ServerJob &job : doneJobs) {
+            ServerConnection *connection = &server->connections[job.fd];
+
+            connection->isBusy = false;
+
+            if (!connection->isBroken) {
+                  appendReply(connection, job.reply, job.replyLength);
+                  dispatchCommands(server, connection);
+            }
+
+            closeConnectionIfDone(server, connection);
+      }
+}
+
+void appendReply(ServerConnection *connection, const char *reply, const int length) {
+      connection->output.insert(connection->output.end(), reply, reply + length);
+}
+
+// Writes what the socket takes now; the rest waits for EPOLLOUT.
+void flushConnection(Server *server, ServerConnection *connection) {
+      while (connection->outputOffset < connection->output.size()) {
+            const ssize_t writtenCount =
+                send(connection->fd, connection->output.data() + connection->outputOffset,
+                     connection->output.size() - connection->outputOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+            if (writtenCount == -1) {
+                  if (errno == EINTR) continue;
+                  if (errno != EAGAIN) connection->isBroken = true;
+
+                  break;
+            }
+
+            connection->outputOffset += writtenCount;
+      }
+
+      if (connection->outputOffset == connection->output.size()) {
+            connection->output.clear();
+            connection->outputOffset = 0;
+      }
+
+      updateConnectionEvents(server, connection);
+}
+
+// A broken socket leaves epoll at once, as epoll would report its hang-up over and over while a
+// worker still has its command.
+void updateConnectionEvents(Server *server, ServerConnection *connection) {
+      if (connection->isBroken) {
+            if (connection->isWatched) epoll_ctl(server->epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+
+            connection->isWatched = false;
+
+            return;
+      }
+
+      uint32_t events = 0;
+
+      if (!connection->isInputClosed) events |= EPOLLIN;
+      if (!connection->output.empty()) events |= EPOLLOUT;
+
+      if (events == connection->events) return;
+
+      epoll_event event{};
+      event.events = events;
+      event.data.fd = connection->fd;
+      epoll_ctl(server->epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+
+      connection->events = events;
+}
+
+// Closed once no worker has its command and it has nothing more to say or can't say it anymore.
+void closeConnectionIfDone(Server *server, ServerConnection *connection) {
+      if (connection->isBusy) {
+            updateConnectionEvents(server, connection);
+
+            return;
+      }
+
+      if (connection->isBroken || (connection->isInputClosed && connection->output.empty()))
+            closeConnection(server, connection);
+      else
+            updateConnectionEvents(server, connection);
+}
+
+// Closing the socket takes it out of epoll as well.
+void closeConnection(Server *server, ServerConnection *connection) {
+      close(connection->fd);
+      freeSession(&server->arena, connection->sessionSlot);
+
+      connection->fd = -1;
+      connection->input.clear();
+      connection->output.clear();
+
+      server->sessionsCount--;
+      setAccepting(server, true);
+}
+
+BoardSession *allocateSession(SessionArena *arena, uint32_t *slot) {
+      if (arena->freeSlots.empty()) {
+            if (arena->slotsCount == arena->chunks.size() * SESSION_CHUNK_SIZE)
+                  arena->chunks.push_back(new BoardSession[SESSION_CHUNK_SIZE]);
+
+            *slot = arena->slotsCount++;
+      } else {
+            *slot = arena->freeSlots.back();
+            arena->freeSlots.pop_back();
+      }
+
+      return &arena->chunks[*slot / SESSION_CHUNK_SIZE][*slot % SESSION_CHUNK_SIZE];
+}
+
+void freeSession(SessionArena *arena, const uint32_t slot) { arena->freeSlots.push_back(slot); }
+
+void freeSessionArena(SessionArena *arena) {
+      for (BoardSession *chunk : arena->chunks) delete[] chunk;
+
+      *arena = SessionArena{};
+}
@@ -0,0 +1,273 @@
+// stats.cpp - counters, histograms and the Chrome trace of --stats and --trace
+#include "sudoku.h"
+
+int statsMode = 0;
+
+// Shards of every thread which recorded anything. They are never freed, so the ones of finished
+// threads are still there for the report.
+std::mutex statsShardsMutex;
+std::vector<StatsShard *> statsShards;
+uint64_t statsStartNs = 0;
+
+void enableStats(const int mode) {
+      if (!SUDOKU_STATS && mode != 0)
+            std::cerr << "This build has the stats compiled out (SUDOKU_STATS=0)." << std::endl;
+
+      statsStartNs = getStatsClock();
+      statsMode = SUDOKU_STATS ? mode : 0;
+}
+
+// Reports to standard error and writes the trace, if there is a path for it. Every thread which
+// recorded must be done by now.
+bool finishStats(const char *tracePath) {
+      const int mode = statsMode;
+
+      statsMode = 0;
+
+      if (mode & STATS_REPORTED) {
+            std::vector<char> report;
+            appendStatsReport(&report);
+
+            fwrite(report.data(), 1, report.size(), stderr);
+      }
+
+      if (SUDOKU_STATS && tracePath != nullptr && !writeTrace(tracePath)) {
+            std::cerr << "Can't write the trace to " << tracePath << "." << std::endl;
+
+            return false;
+      }
+
+      return true;
+}
+
+StatsShard *getThreadStatsShard() {
+      thread_local StatsShard *shard = nullptr;
+
+      if (shard == nullptr) {
+            shard = new StatsShard{};
+
+            for (Histogram &histogram : shard->histograms) histogram.min = UINT64_MAX;
+
+            std::lock_guard<std::mutex> lock(statsShardsMutex);
+            shard->threadIndex = statsShards.size();
+            statsShards.push_back(shard);
+      }
+
+      return shard;
+}
+
+// Past MAX_TRACE_EVENTS_COUNT events a thread only counts the ones it drops, so a long run can't
+// take all the memory.
+void recordStatSample(const StatHistogram histogram, const uint64_t startNs, const uint64_t value) {
+      StatsShard *shard = getThreadStatsShard();
+      Histogram *counts = &shard->histograms[histogram];
+
+      counts->bucketCounts[getStatBucket(value)]++;
+      counts->count++;
+      counts->sum += value;
+      counts->min = std::min(counts->min, value);
+      counts->max = std::max(counts->max, value);
+
+      if ((statsMode & STATS_TRACED) == 0) return;
+
+      if (shard->events.size() == MAX_TRACE_EVENTS_COUNT)
+            shard->droppedEventsCount++;
+      else
+            shard->events.push_back(TraceEvent{startNs - statsStartNs, value, histogram});
+}
+
+int getStatBucket(const uint64_t value) {
+      if (value < (uint64_t)STAT_EXACT_VALUES_COUNT) return value;
+
+      const int exponent = 63 - __builtin_clzll(value);
+      const int shift = exponent - STAT_SUB_BUCKET_BITS;
+      const int subBucket = (value >> shift) & ((1 << STAT_SUB_BUCKET_BITS) - 1);
+
+      return STAT_EXACT_VALUES_COUNT + ((shift - 1) << STAT_SUB_BUCKET_BITS) + subBucket;
+}
+
+// Largest value of the bucket.
+uint64_t getStatBucketLimit(const int bucket) {
+      if (bucket < STAT_EXACT_VALUES_COUNT) return bucket;
+
+      const int shift = ((bucket - STAT_EXACT_VALUES_COUNT) >> STAT_SUB_BUCKET_BITS) + 1;
+      const uint64_t subBucket = (bucket - STAT_EXACT_VALUES_COUNT) & ((1 << STAT_SUB_BUCKET_BITS) - 1);
+      const uint64_t first = ((1ull << STAT_SUB_BUCKET_BITS) + subBucket) << shift;
+
+      return first + ((1ull << shift) - 1);
+}
+
+// Nearest-rank percentile, as the limit of its bucket but no more than the largest value seen.
+uint64_t getHistogramPercentile(const Histogram *histogram, const int percent) {
+      const uint64_t rank = std::max<uint64_t>((histogram->count * percent + 99) / 100, 1);
+
+      uint64_t seenCount = 0;
+
+      for (int bucket = 0; bucket < STAT_BUCKETS_COUNT; bucket++) {
+            seenCount += histogram->bucketCounts[bucket];
+
+            if (seenCount >= rank) return std::min(getStatBucketLimit(bucket), histogram->max);
+      }
+
+      return histogram->max;
+}
+
+void addHistogram(const Histogram *from, Histogram *to) {
+      for (int bucket = 0; bucket < STAT_BUCKETS_COUNT; bucket++)
+            to->bucketCounts[bucket] += from->bucketCounts[bucket];
+
+      to->count += from->count;
+      to->sum += from->sum;
+      to->min = std::min(to->min, from->min);
+      to->max = std::max(to->max, from->max);
+}
+
+// The counters, a line of percentiles per histogram, and the histograms themselves.
+void appendStatsReport(std::vector<char> *output) {
+      char line[256];
+      int length;
+
+      uint64_t counts[STAT_COUNTERS_COUNT] = {};
+      Histogram histograms[STAT_HISTOGRAMS_COUNT] = {};
+      uint64_t droppedEventsCount = 0;
+
+      for (Histogram &histogram : histograms) histogram.min = UINT64_MAX;
+
+      for (const StatsShard *shard : statsShards) {
+            for (int counter = 0; counter < STAT_COUNTERS_COUNT; counter++)
+                  counts[counter] += shard->counts[counter];
+            for (int i = 0; i < STAT_HISTOGRAMS_COUNT; i++)
+                  addHistogram(&shard->histograms[i], &histograms[i]);
+
+            droppedEventsCount += shard->droppedEventsCount;
+      }
+
+      length = snprintf(line, sizeof(line), "Stats of %zu threads:\n", statsShards.size());
+      output->insert(output->end(), line, line + length);
+
+      for (int counter = 0; counter < STAT_COUNTERS_COUNT; counter++) {
+            length = snprintf(line, sizeof(line), "  %-26s %12llu\n", STAT_COUNTER_NAMES[counter],
+                              (unsigned long long)counts[counter]);
+            output->insert(output->end(), line, line + length);
+      }
+
+      if (droppedEventsCount != 0) {
+            length = snprintf(line, sizeof(line), "  %-26s %12llu\n", "trace.dropped-events",
+                              (unsigned long long)droppedEventsCount);
+            output->insert(output->end(), line, line + length);
+      }
+
+      length = snprintf(line, sizeof(line), "  %-26s %10s %10s %10s %10s %10s %10s %12s\n",
+                        "histogram (ns, bytes)", "count", "min", "p50", "p90", "p99", "max", "mean");
+      output->insert(output->end(), line, line + length);
+
+      for (int i = 0; i < STAT_HISTOGRAMS_COUNT; i++) {
+            const Histogram *histogram = &histograms[i];
+
+            if (histogram->count == 0) continue;
+
+            length = snprintf(line, sizeof(line),
+                              "  %-26s %10llu %10llu %10llu %10llu %10llu %10llu %12.1f\n",
+                              STAT_HISTOGRAM_NAMES[i], (unsigned long long)histogram->count,
+                              (unsigned long long)histogram->min,
+                              (unsigned long long)getHistogramPercentile(histogram, 50),
+                              (unsigned long long)getHistogramPercentile(histogram, 90),
+                              (unsigned long long)getHistogramPercentile(histogram, 99),
+                              (unsigned long long)histogram->max, (double)histogram->sum / histogram->count);
+            output->insert(output->end(), line, line + length);
+      }
+
+      for (int i = 0; i < STAT_HISTOGRAMS_COUNT; i++) {
+            if (histograms[i].count != 0)
+                  appendHistogramBars(STAT_HISTOGRAM_NAMES[i], &histograms[i], output);
+      }
+}
+
+// A bar per power of two between the smallest and the largest value.
+void appendHistogramBars(const char *name, const Histogram *histogram, std::vector<char> *output) {
+      const int MAX_BAR_LEN = 40;
+      const int POWERS_COUNT = 64;
+
+      char line[256];
+      int length = snprintf(line, sizeof(line), "%s:\n", name);
+
+      output->insert(output->end(), line, line + length);
+
+      uint64_t powerCounts[POWERS_COUNT] = {};
+      uint64_t maxPowerCount = 0;
+
+      for (int bucket = 0; bucket < STAT_BUCKETS_COUNT; bucket++) {
+            const uint64_t limit = getStatBucketLimit(bucket);
+            const int power = limit == 0 ? 0 : 63 - __builtin_clzll(limit);
+
+            powerCounts[power] += histogram->bucketCounts[bucket];
+            maxPowerCount = std::max(maxPowerCount, powerCounts[power]);
+      }
+
+      const int firstPower = histogram->min == 0 ? 0 : 63 - __builtin_clzll(histogram->min);
+      const int lastPower = histogram->max == 0 ? 0 : 63 - __builtin_clzll(histogram->max);
+
+      for (int power = firstPower; power <= lastPower; power++) {
+            const int barLen = (powerCounts[power] * MAX_BAR_LEN + maxPowerCount - 1) / maxPowerCount;
+
+            length = snprintf(line, sizeof(line), "  %20llu .. %-20llu %10llu %.*s\n",
+                              power == 0 ? 0ull : 1ull << power, (2ull << power) - 1,
+                              (unsigned long long)powerCounts[power], barLen,
+                              "########################################");
+            output->insert(output->end(), line, line + length);
+      }
+}
+
+// Chrome trace JSON, for chrome://tracing or Perfetto: a complete event per timed section and a
+// counter event per value, with the threads in the order they first recorded.
+bool writeTrace(const char *path) {
+      const size_t FLUSH_SIZE = 1 << 20;
+
+      FILE *file = fopen(path, "wb");
+
+      if (file == nullptr) return false;
+
+      std::vector<char> output;
+      char line[256];
+      int length = snprintf(line, sizeof(line), "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+
+      output.insert(output.end(), line, line + length);
+
+      bool isFirst = true;
+
+      for (const StatsShard *shard : statsShards) {
+            for (const TraceEvent &event : shard->events) {
+                  const char *name = STAT_HISTOGRAM_NAMES[event.histogram];
+                  const char *separator = isFirst ? "\n" : ",\n";
+
+                  if (IS_STAT_HISTOGRAM_TIMED[event.histogram]) {
+                        length = snprintf(line, sizeof(line),
+                                          "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                                          "\"ts\": %.3f, \"dur\": %.3f}",
+                                          separator, name, shard->threadIndex, event.startNs / 1000.0,
+                                          event.value / 1000.0);
+                  } else {
+                        length = snprintf(line, sizeof(line),
+                                          "%s{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"tid\": %d, "
+                                          "\"ts\": %.3f, \"args\": {\"value\": %llu}}",
+                                          separator, name, shard->threadIndex, event.startNs / 1000.0,
+                                          (unsigned long long)event.value);
+                  }
+
+                  output.insert(output.end(), line, line + length);
+                  isFirst = false;
+
+                  if (output.size() >= FLUSH_SIZE) {
+                        fwrite(output.data(), 1, output.size(), file);
+                        output.clear();
+                  }
+            }
+      }
+
+      length = snprintf(line, sizeof(line), "\n]}\n");
+      output.insert(output.end(), line, line + length);
+
+      fwrite(output.data(), 1, output.size(), file);
+
+      return fclose(file) == 0;
+}
@@ -1,588 +1,448 @@
 // sudoku.cpp - simple console game
-#include <iostream>
-#include <random>
-#include <vector>
-
-enum Color {
-      BlackFg = 90,
-      BlackBg = 40,
-      RedFg = 31,
-      RedBg = 41,
-      GreenFg = 32,
-      GreenBg = 42,
-      YellowFg = 33,
-      YellowBg = 43,
-      MagentaFg = 35,
-      MagentaBg = 45,
-      CyanFg = 36,
-      CyanBg = 46,
-      Default = 0
-};
+#include "sudoku.h"
 
-void game();
-void initDigits(int ***defaultDigitsPtr, int ***solvedDigitsPtr, int ***currentDigitsPtr,
-                const int dimension);
-void doActionWithPlayerInput(char *playerInput, int *playerPosX, int *playerPosY, int ***currentDigits,
-                             int ***defaultDigits, int ***solvedMtrx, int dimension,
-                             int *countOfCorrectDigitsShown, bool *isMenuShown);
-void drawField(int ***digits, int ***defaultDigits, const int dimension, const int playerPosX,
-               const int playerPosY);
-void setCountOfCorrectDigitsShown(int &countOfCorrectDigitsShown, int ***defaultDigits, int ***digits,
-                                  const int dimension);
+#include <csignal>
 
-void fillMtrxOfRandomDigitsFully(int ***mtrxPtr, const int dimension);
-void hideAnyRandomDigits(int ***digitsPtr);
-void hideDigitsInThisSection(int ***digitPtr, int amountOfHiddenDigits, const int startRow,
-                             const int startCol);
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
 
-void copyDigits(int ***from, int ***to, const int dimension);
-void clearLine(int ***digitsPtr, const int dimension, const int indexOfLine);
+const int INPUT_BUFFER_SIZE = 64;
 
-void refreshField(int ***currentDigits, int ***defaultDigits, const int dimension, int *playerPosY,
-                  int *playerPosX, int *initialDigitsShownCount);
-void refreshCurrentData(int ***defaultDigits, const int dimension, int *playerPosY, int *playerPosX,
-                        int *initialDigitsShownCount);
-void recreateDigits(int ***currentDigits, int ***defaultDigits, int ***solvedMtrx, const int dimension,
-                    int *playerPosY, int *playerPosX, int *initialDigitsShownCount);
+// Keys which aren't characters; the terminal sends them as escape sequences.
+enum Key { UpKey = 256, DownKey, RightKey, LeftKey, UnknownKey };
 
-void clearSell(int ***currentDigits, int ***defaultDigits, const int row, const int col, const int dimension);
-void changeSell(int ***currentDigits, int ***defaultDigits, const int row, const int col, const int dimension,
-                const char playerInput);
+// Bytes read from the terminal and not decoded into keys yet.
+struct Input {
+      unsigned char bytes[INPUT_BUFFER_SIZE];
+      int begin, end;
+      bool isClosed;
+};
 
-template <typename T>
-void setColor(const int fgColor, const int bgColor, const T text);
-void clear();
+template <int SECTION_LEN>
+void game(const uint64_t seed, const PuzzleDb *db);
+
+template <int SECTION_LEN>
+void doActionWithPlayerInput(Screen *screen, Input *input, int playerInput, GameSession<SECTION_LEN> *session,
+                             const PuzzleDb *db, PuzzlePool<SECTION_LEN> *pool);
+
+void enableRawMode();
+void restoreTerminalMode();
+void restoreTerminalModeOnSignal(int signalNumber);
+int readKey(Input *input);
+bool hasPendingKey(Input *input);
+bool fillInput(Input *input, const int timeoutMs);
+
+template <int SECTION_LEN>
+void showHint(Screen *screen, Input *input, BasicBoard<SECTION_LEN> *currentDigits,
+              BasicBoard<SECTION_LEN> *defaultDigits, BasicBoard<SECTION_LEN> *solvedMtrx,
+              const Progress<SECTION_LEN> *progress, const int dimension, int *playerPosX, int *playerPosY);
+
+// Mode of the terminal before the game switched it to raw input, put back on exit and on the
+// signals which end the game.
+termios savedTerminalMode;
+volatile sig_atomic_t isRawModeEnabled = 0;
+
+int main(int argc, char *argv[]) {
+      uint64_t seed = time(nullptr);
+      uint64_t dimension = BOARD_DIMENSION;
+      const char *dbPath = nullptr;
+      const char *tracePath = nullptr;
+      bool isStatsReported = false;
+
+      if (argc > 1 && strcmp(argv[1], "generate") == 0) return runGenerateMode(argc - 1, argv + 1);
+      if (argc > 1 && strcmp(argv[1], "solve") == 0) return runSolveMode(argc - 1, argv + 1);
+      if (argc > 1 && strcmp(argv[1], "pack") == 0) return runPackMode(argc - 1, argv + 1);
+      if (argc > 1 && strcmp(argv[1], "unpack") == 0) return runUnpackMode(argc - 1, argv + 1);
+      if (argc > 1 && strcmp(argv[1], "serve") == 0) return runServeMode(argc - 1, argv + 1);
+
+      for (int i = 1; i < argc; i++) {
+            bool hasValue = i + 1 < argc;
+            bool isParsed = false;
+
+            if (strcmp(argv[i], "--seed") == 0 && hasValue)
+                  isParsed = parseUnsignedOption(argv[++i], &seed);
+            else if (strcmp(argv[i], "--size") == 0 && hasValue)
+                  isParsed = parseUnsignedOption(argv[++i], &dimension);
+            else if (strcmp(argv[i], "--db") == 0 && hasValue)
+                  isParsed = (dbPath = argv[++i]) != nullptr;
+            else if (strcmp(argv[i], "--stats") == 0)
+                  isParsed = isStatsReported = true;
+            else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+                  isParsed = (tracePath = argv[++i]) != nullptr;
+
+            if (!isParsed) {
+                  std::cerr << "Usage: " << argv[0] << " [--seed N] [--size 4|9|16|25] [--db FILE] [--stats]"
+                            << " [--trace FILE]" << std::endl;
+                  std::cerr << "       " << argv[0] << " generate [options]" << std::endl;
+                  std::cerr << "       " << argv[0] << " solve [options]" << std::endl;
+                  std::cerr << "       " << argv[0] << " pack [options]" << std::endl;
+                  std::cerr << "       " << argv[0] << " unpack [options]" << std::endl;
+                  std::cerr << "       " << argv[0] << " serve [options]" << std::endl;
+
+                  return 1;
+            }
+      }
 
-void showRules();
-void showMenu(const int countOfCorrectDigitsShown);
-void showHint(int ***solvedMtrx, int ***defaultDigits, const int dimension);
-void showEndOfGame(const int filledSellsCount);
+      if (dbPath != nullptr && dimension != BOARD_DIMENSION) {
+            std::cerr << "A puzzle database holds 9x9 fields only." << std::endl;
 
-void allocateMtrxs(const int dimension, std::vector<int ***> mtrxPtrs);
-void freeMtrxs(const int dimension, std::vector<int ***> mtrxPtrs);
+            return 1;
+      }
 
-Color getFgColor(int ***digits, int ***defaultDigits, const int dimension, const int row, const int col,
-                 const int playerPosX, const int playerPosY);
+      PuzzleDb db{};
 
-int getRandomUnusedDigit(int ***mtrxPtr, const int dimension, const int row, const int col);
-int getCountOfShownDigits(int ***defaultDigits, const int dimension);
+      if (dbPath != nullptr && !openPuzzleDb(dbPath, &db)) {
+            std::cerr << "Can't read " << dbPath << " as a puzzle database." << std::endl;
 
-bool hasDigitInHorizontalLine(int ***mtrx, const int dimension, const int row, const int col,
-                              const int digit);
-bool hasDigitInVerticalLine(int ***mtrx, const int dimension, const int row, const int col, const int digit);
-bool hasDigitInCurrentSection(int ***mtrx, const int digit, const int row, const int col);
+            return 1;
+      }
 
-bool isDefaultDigit(int ***currentDigits, int ***defaultDigits, const int row, const int col);
-bool isEnteredDigitCorrect(int ***digits, const int dimension, const int row, const int col);
+      enableStats((isStatsReported ? STATS_REPORTED : 0) | (tracePath != nullptr ? STATS_TRACED : 0));
 
-int main() {
-      srand(time(NULL));
+      switch (dimension) {
+            case BoardSize<2>::DIMENSION:
+                  game<2>(seed, nullptr);
+                  break;
+            case BoardSize<3>::DIMENSION:
+                  game<3>(seed, dbPath == nullptr ? nullptr : &db);
+                  break;
+            case BoardSize<4>::DIMENSION:
+                  game<4>(seed, nullptr);
+                  break;
+            case BoardSize<5>::DIMENSION:
+                  game<5>(seed, nullptr);
+                  break;
+            default:
+                  std::cerr << "The field size must be 4, 9, 16 or 25." << std::endl;
+
+                  return 1;
+      }
 
-      game();
+      if (dbPath != nullptr) closePuzzleDb(&db);
 
-      return 0;
+      return finishStats(tracePath) ? 0 : 1;
 }
 
-void game() {
-      const int DIMENSION = 9;
-      const int END_COUNT = 81;
-      const int MIDDLE = 4;
-      const char ESC = '\x1B';
+template <int SECTION_LEN>
+void game(const uint64_t seed, const PuzzleDb *db) {
+      const int DIMENSION = BoardSize<SECTION_LEN>::DIMENSION;
+      const int END_COUNT = BoardSize<SECTION_LEN>::CELLS_COUNT;
+      const int ESC = '\x1B';
 
-      int **defaultDigits = nullptr, **currentDigits = nullptr, **solvedMtrx = nullptr;
-      allocateMtrxs(DIMENSION, {&defaultDigits, &currentDigits, &solvedMtrx});
-      initDigits(&defaultDigits, &solvedMtrx, &currentDigits, DIMENSION);
+      // The first field comes before the pool starts, so a seed always gives the same one.
+      GameSession<SECTION_LEN> session;
+      startGameSession(&session, seed, 0, db);
+      // A database has the puzzles at hand already, so the pool gets no difficulties and no thread.
+      // A database has the puzzles at hand already and needs no pool.
+      PuzzlePool<SECTION_LEN> pool;
+      startPuzzlePool(&pool, seed, db == nullptr ? 1 << Difficulty::Medium : 0);
 
-      int playerPosX = MIDDLE, playerPosY = MIDDLE;
       int countOfCorrectDigitsShown = 0;
-      int initialDigitsShownCount = getCountOfShownDigits(&defaultDigits, DIMENSION);
 
-      char playerInput;
+      int playerInput;
 
-      bool isMenuShown = true;
+      bool areRulesShown = true;
 
-      showRules();
+      Screen screen{};
+      Input input{};
+
+      enableRawMode();
+
+      // From the first key of a batch until the frame which shows what the keys did is out.
+      uint64_t keyStartNs = 0;
 
       do {
-            drawField(&currentDigits, &defaultDigits, DIMENSION, playerPosX, playerPosY);
+            const uint64_t drawStartNs = startStatTimer();
+
+            clearScreen(&screen);
 
-            setCountOfCorrectDigitsShown(countOfCorrectDigitsShown, &defaultDigits, &currentDigits,
-                                         DIMENSION);
+            if (areRulesShown) showRules(&screen, DIMENSION, SECTION_LEN);
+            areRulesShown = false;
 
-            if (isMenuShown)
-                  showMenu(countOfCorrectDigitsShown);
+            drawField(&screen, &session.currentDigits, &session.defaultDigits, &session.progress, DIMENSION,
+                      session.playerPosX, session.playerPosY);
+
+            setCountOfCorrectDigitsShown(countOfCorrectDigitsShown, &session.progress);
+
+            if (session.isMenuShown)
+                  showMenu(&screen, countOfCorrectDigitsShown, DIMENSION, pool.hitsCount, pool.missesCount);
             else
-                  setColor(Color::BlackFg, Color::Default, "\nm - show menu;\n");
+                  putText(&screen, Color::BlackFg, Color::Default, "\nm - show menu;\n");
 
-            if (countOfCorrectDigitsShown != END_COUNT) {
-                  doActionWithPlayerInput(&playerInput, &playerPosX, &playerPosY, &currentDigits,
-                                          &defaultDigits, &solvedMtrx, DIMENSION, &initialDigitsShownCount,
-                                          &isMenuShown);
-            } else {
-                  break;
-            }
+            stopStatTimer(StatHistogram::DrawTime, drawStartNs);
 
-            clear();
-      } while (playerInput != ESC);
+            if (countOfCorrectDigitsShown == END_COUNT) break;
 
-      if (countOfCorrectDigitsShown == END_COUNT) showEndOfGame(END_COUNT - initialDigitsShownCount);
+            presentScreen(&screen);
+            stopStatTimer(StatHistogram::KeyLatency, keyStartNs);
 
-      freeMtrxs(DIMENSION, {&defaultDigits, &currentDigits, &solvedMtrx});
-}
+            keyStartNs = 0;
 
-void setCountOfCorrectDigitsShown(int &countOfCorrectDigitsShown, int ***defaultDigits, int ***digits,
-                                  const int dimension) {
-      const int HIDDEN_DIGIT = 0;
-      countOfCorrectDigitsShown = 0;
+            // Keys which came while the frame was drawn, like the repeats of a held key, are all
+            // handled before the next frame.
+            do {
+                  playerInput = readKey(&input);
 
-      for (int i = 0; i < dimension; i++) {
-            for (int j = 0; j < dimension; j++) {
-                  bool isDefaultDigit = *(*(*defaultDigits + i) + j) == *(*(*digits + i) + j);
-                  bool isShownDigit = (*(*(*digits + i) + j)) != HIDDEN_DIGIT;
+                  if (keyStartNs == 0) keyStartNs = startStatTimer();
+                  countStat(StatCounter::KeysRead, 1);
 
-                  if (!isShownDigit)
-                        continue;
-                  else if (isEnteredDigitCorrect(digits, dimension, i, j) || isDefaultDigit)
-                        countOfCorrectDigitsShown++;
-            }
-      }
-}
+                  const uint64_t actionStartNs = startStatTimer();
 
-void initDigits(int ***defaultDigitsPtr, int ***solvedDigitsPtr, int ***currentDigitsPtr,
-                const int dimension) {
-      fillMtrxOfRandomDigitsFully(solvedDigitsPtr, dimension);
+                  doActionWithPlayerInput(&screen, &input, playerInput, &session, db, &pool);
 
-      copyDigits(solvedDigitsPtr, defaultDigitsPtr, dimension);
+                  stopStatTimer(StatHistogram::ActionTime, actionStartNs);
+            } while (playerInput != ESC && session.progress.correctDigitsCount != END_COUNT &&
+                     hasPendingKey(&input));
+      } while (playerInput != ESC);
 
-      hideAnyRandomDigits(defaultDigitsPtr);
+      stopPuzzlePool(&pool);
 
-      copyDigits(defaultDigitsPtr, currentDigitsPtr, dimension);
+      if (countOfCorrectDigitsShown == END_COUNT) {
+            showEndOfGame(&screen, END_COUNT - session.initialDigitsShownCount);
+      } else {
+            clearScreen(&screen);
+            presentScreen(&screen);
+      }
+
+      restoreTerminalMode();
 }
 
-void doActionWithPlayerInput(char *playerInput, int *playerPosX, int *playerPosY, int ***currentDigits,
-                             int ***defaultDigits, int ***solvedMtrx, int dimension,
-                             int *initialDigitsShownCount, bool *isMenuShown) {
+template <int SECTION_LEN>
+void doActionWithPlayerInput(Screen *screen, Input *input, int playerInput, GameSession<SECTION_LEN> *session,
+                             const PuzzleDb *db, PuzzlePool<SECTION_LEN> *pool) {
+      const int DIMENSION = BoardSize<SECTION_LEN>::DIMENSION;
       const int INDENT_TO_CAPITAL_LETTER = 32;
 
-      std::cout << "\nInput: _\b";
-      std::cin >> *playerInput;
-      *playerInput =
-          *playerInput >= 'A' && *playerInput <= 'Z' ? *playerInput + INDENT_TO_CAPITAL_LETTER : *playerInput;
+      // Digits above 9 are capital letters, so on the larger fields commands take lowercase only.
+      const int inputDigit = playerInput < UpKey ? getCharDigit(playerInput) : 0;
+
+      if (inputDigit != 0 && inputDigit <= DIMENSION) {
+            doSessionAction(session, SessionAction::PutDigit, inputDigit, db, pool);
+
+            return;
+      }
+
+      playerInput =
+          playerInput >= 'A' && playerInput <= 'Z' ? playerInput + INDENT_TO_CAPITAL_LETTER : playerInput;
 
-      switch (*playerInput) {
+      switch (playerInput) {
             case 'w':
-                  *playerPosY = (*playerPosY) - 1 != -1 ? (*playerPosY) - 1 : (*playerPosY);
+            case Key::UpKey:
+                  doSessionAction(session, SessionAction::MoveUp, 0, db, pool);
                   break;
             case 's':
-                  *playerPosY = (*playerPosY) + 1 != dimension ? (*playerPosY) + 1 : (*playerPosY);
+            case Key::DownKey:
+                  doSessionAction(session, SessionAction::MoveDown, 0, db, pool);
                   break;
             case 'a':
-                  *playerPosX = (*playerPosX) - 1 != -1 ? (*playerPosX) - 1 : (*playerPosX);
+            case Key::LeftKey:
+                  doSessionAction(session, SessionAction::MoveLeft, 0, db, pool);
                   break;
             case 'd':
-                  *playerPosX = (*playerPosX) + 1 != dimension ? (*playerPosX) + 1 : (*playerPosX);
+            case Key::RightKey:
+                  doSessionAction(session, SessionAction::MoveRight, 0, db, pool);
                   break;
             case '0':
-                  clearSell(currentDigits, defaultDigits, *playerPosY, *playerPosX, dimension);
-                  break;
-            case '1':
-            case '2':
-            case '3':
-            case '4':
-            case '5':
-            case '6':
-            case '7':
-            case '8':
-            case '9':
-                  changeSell(currentDigits, defaultDigits, *playerPosY, *playerPosX, dimension, *playerInput);
+                  doSessionAction(session, SessionAction::ClearDigit, 0, db, pool);
                   break;
             case 'm':
-                  *isMenuShown = true;
+                  doSessionAction(session, SessionAction::ShowMenu, 0, db, pool);
                   break;
             case 'c':
-                  *isMenuShown = false;
+                  doSessionAction(session, SessionAction::HideMenu, 0, db, pool);
                   break;
             case 'r':
-                  refreshField(currentDigits, defaultDigits, dimension, playerPosY, playerPosX,
-                               initialDigitsShownCount);
+                  doSessionAction(session, SessionAction::ResetField, 0, db, pool);
                   break;
             case 'h':
-                  showHint(solvedMtrx, defaultDigits, dimension);
+                  showHint(screen, input, &session->currentDigits, &session->defaultDigits,
+                           &session->solvedMtrx, &session->progress, DIMENSION, &session->playerPosX,
+                           &session->playerPosY);
                   break;
             case 'n':
-                  recreateDigits(currentDigits, defaultDigits, solvedMtrx, dimension, playerPosY, playerPosX,
-                                 initialDigitsShownCount);
+                  doSessionAction(session, SessionAction::NewField, 0, db, pool);
                   break;
       }
 }
 
-void drawField(int ***digits, int ***defaultDigits, const int dimension, const int playerPosX,
-               const int playerPosY) {
-      using std::cout, std::endl;
-
-      const int SIDE_BORDERS_COUNT = 4;
-      const char VERTICAL_LINE = '|', HORIZONTAL_LINE = '-';
-      const char SPACE_BAR = ' ';
-      const char HIDDEN_CELL = '*';
+// Switches the terminal to raw input: keys come one by one as they are pressed, without echo. Ctrl+C
+// still ends the game, and the terminal gets its mode back then as well. Does nothing when the
+// input isn't a terminal.
+void enableRawMode() {
+      const int ENDING_SIGNALS[] = {SIGINT, SIGTERM, SIGHUP, SIGQUIT};
+      const char HIDE_CURSOR[] = "\x1B[?25l";
 
-      Color fgColor = Color::Default, bgColor = Color::Default;
+      if (isRawModeEnabled || tcgetattr(STDIN_FILENO, &savedTerminalMode) == -1) return;
 
-      for (int i = 0, row = 0; i < dimension + SIDE_BORDERS_COUNT; i++) {
-            for (int j = 0, col = 0; j < dimension + SIDE_BORDERS_COUNT; j++) {
-                  cout << SPACE_BAR;
+      termios rawMode = savedTerminalMode;
+      rawMode.c_lflag &= ~(ICANON | ECHO);
+      rawMode.c_cc[VMIN] = 1;
+      rawMode.c_cc[VTIME] = 0;
 
-                  fgColor = getFgColor(digits, defaultDigits, dimension, row, col, playerPosX, playerPosY);
+      for (int signalNumber : ENDING_SIGNALS) signal(signalNumber, restoreTerminalModeOnSignal);
+      atexit(restoreTerminalMode);
 
-                  if (i % 4 == 0)
-                        setColor(Color::Default, Color::Default, HORIZONTAL_LINE);
-                  else if (j % 4 == 0)
-                        setColor(Color::Default, Color::Default, VERTICAL_LINE);
-                  else if (*(*(*digits + row) + col) == 0)
-                        setColor(fgColor, bgColor, HIDDEN_CELL);
-                  else
-                        setColor(fgColor, bgColor, *(*(*digits + row) + col));
+      if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &rawMode) == -1) return;
 
-                  col = j % 4 != 0 ? col + 1 : col;
-            }
-
-            row = i % 4 != 0 && row + 1 != dimension ? row + 1 : row;
-
-            cout << endl;
-      }
+      isRawModeEnabled = 1;
+      writeWholeBuffer(STDOUT_FILENO, HIDE_CURSOR, strlen(HIDE_CURSOR));
 }
 
-void fillMtrxOfRandomDigitsFully(int ***mtrxPtr, const int dimension) {
-      int clearedLinesCount = 0;
-      int clastClearedLine = 0;
+// Safe to call from a signal handler.
+void restoreTerminalMode() {
+      const char SHOW_CURSOR[] = "\x1B[?25h";
 
-      for (int i = 0; i < dimension; i++) {
-            for (int j = 0; j < dimension; j++) {
-                  int result = getRandomUnusedDigit(mtrxPtr, dimension, i, j);
+      if (!isRawModeEnabled) return;
 
-                  if (result != -1) {
-                        *(*(*mtrxPtr + i) + j) = result;
-                  } else {
-                        clearLine(mtrxPtr, dimension, i);
-
-                        if (++clearedLinesCount > 1 && clastClearedLine == i) {
-                              for (int k = 0; k <= i; k++) clearLine(mtrxPtr, dimension, k);
-
-                              i = 0;
-
-                              clearedLinesCount = 0;
-                        }
-
-                        j = -1;
-
-                        clastClearedLine = i;
-                  }
-            }
-      }
+      isRawModeEnabled = 0;
+      tcsetattr(STDIN_FILENO, TCSAFLUSH, &savedTerminalMode);
+      writeWholeBuffer(STDOUT_FILENO, SHOW_CURSOR, strlen(SHOW_CURSOR));
 }
 
-void hideAnyRandomDigits(int ***digitsPtr) {
-      const int LEFT_GROUND = 5, RIGHT_GROUND = 7;
-      const int SECTIONS_COUNT = 9;
-      const int SECTION_LEN = 3;
+void restoreTerminalModeOnSignal(int signalNumber) {
+      restoreTerminalMode();
 
-      for (int i = 0; i < SECTIONS_COUNT; i++) {
-            int amountOfHiddenDigits = LEFT_GROUND + rand() % (RIGHT_GROUND - LEFT_GROUND + 1);
-
-            int startIndexOfSectionRow = SECTION_LEN * (i / SECTION_LEN);
-            int startIndexOfSectionCol = SECTION_LEN * (i - SECTION_LEN * (i / SECTION_LEN));
-
-            hideDigitsInThisSection(digitsPtr, amountOfHiddenDigits, startIndexOfSectionRow,
-                                    startIndexOfSectionCol);
-      }
+      signal(signalNumber, SIG_DFL);
+      raise(signalNumber);
 }
 
-void hideDigitsInThisSection(int ***digitPtr, int amountOfHiddenDigits, const int startRow,
-                             const int startCol) {
-      const int SECTION_LEN = 3;
-
-      while (amountOfHiddenDigits != 0) {
-            int randomDigit = 1 + rand() % 9;
-
-            bool isFound = false;
-            while (!isFound) {
-                  randomDigit = randomDigit < 9 ? randomDigit + 1 : 1;
-
-                  for (int i = startRow; !isFound && i < startRow + SECTION_LEN; i++) {
-                        for (int j = startCol; !isFound && j < startCol + SECTION_LEN; j++) {
-                              if (*(*(*digitPtr + i) + j) == randomDigit) {
-                                    *(*(*digitPtr + i) + j) = 0;
-
-                                    isFound = true;
+// Blocks until a whole key is read: a character or, for an escape sequence, one of Key. A closed
+// input reads as Esc, which ends the game.
+int readKey(Input *input) {
+      const int ESC = '\x1B';
+      const int ESCAPE_SEQUENCE_TIMEOUT_MS = 30;
 
-                                    amountOfHiddenDigits--;
-                              }
-                        }
-                  }
-            }
-      }
-}
+      while (input->begin == input->end) {
+            if (input->isClosed) return ESC;
 
-void copyDigits(int ***from, int ***to, const int dimension) {
-      for (int i = 0; i < dimension; i++) {
-            for (int j = 0; j < dimension; j++) {
-                  *(*(*to + i) + j) = *(*(*from + i) + j);
-            }
+            fillInput(input, -1);
       }
-}
-
-void clearLine(int ***digitsPtr, const int dimension, const int indexOfLine) {
-      const int DEFAULT_VALUE = 0;
-
-      for (int i = 0; i < dimension; i++) *(*(*digitsPtr + indexOfLine) + i) = DEFAULT_VALUE;
-}
-
-void refreshField(int ***currentDigits, int ***defaultDigits, const int dimension, int *playerPosY,
-                  int *playerPosX, int *initialDigitsShownCount) {
-      copyDigits(defaultDigits, currentDigits, dimension);
-
-      refreshCurrentData(defaultDigits, dimension, playerPosY, playerPosX, initialDigitsShownCount);
-}
 
-void refreshCurrentData(int ***defaultDigits, const int dimension, int *playerPosY, int *playerPosX,
-                        int *initialDigitsShownCount) {
-      const int MIDDLE = 4;
+      const int key = input->bytes[input->begin++];
 
-      *playerPosX = *playerPosY = MIDDLE;
+      if (key != ESC) return key;
 
-      *initialDigitsShownCount = getCountOfShownDigits(defaultDigits, dimension);
-}
+      // A sequence comes at once, so Esc followed by nothing or by another key is the Esc key.
+      if (input->begin == input->end && !fillInput(input, ESCAPE_SEQUENCE_TIMEOUT_MS)) return ESC;
+      if (input->bytes[input->begin] != '[' && input->bytes[input->begin] != 'O') return ESC;
 
-void recreateDigits(int ***currentDigits, int ***defaultDigits, int ***solvedMtrx, const int dimension,
-                    int *playerPosY, int *playerPosX, int *initialDigitsShownCount) {
-      for (int i = 0; i < dimension; i++) clearLine(solvedMtrx, dimension, i);
+      input->begin++;
 
-      initDigits(defaultDigits, solvedMtrx, currentDigits, dimension);
+      // Parameters such as modifiers, then the byte which names the key.
+      for (;;) {
+            if (input->begin == input->end && !fillInput(input, ESCAPE_SEQUENCE_TIMEOUT_MS))
+                  return Key::UnknownKey;
 
-      refreshCurrentData(defaultDigits, dimension, playerPosY, playerPosX, initialDigitsShownCount);
-}
+            const int byte = input->bytes[input->begin++];
 
-void clearSell(int ***currentDigits, int ***defaultDigits, const int row, const int col,
-               const int dimension) {
-      if (!isDefaultDigit(currentDigits, defaultDigits, row, col)) {
-            *(*(*currentDigits + row) + col) = 0;
-      }
-}
+            if (byte >= '0' && byte <= '?') continue;
 
-void changeSell(int ***currentDigits, int ***defaultDigits, const int row, const int col, const int dimension,
-                const char playerInput) {
-      if (!isDefaultDigit(currentDigits, defaultDigits, row, col)) {
-            *(*(*currentDigits + row) + col) = playerInput - '0';
+            switch (byte) {
+                  case 'A':
+                        return Key::UpKey;
+                  case 'B':
+                        return Key::DownKey;
+                  case 'C':
+                        return Key::RightKey;
+                  case 'D':
+                        return Key::LeftKey;
+                  default:
+                        return Key::UnknownKey;
+            }
       }
 }
 
-template <typename T>
-void setColor(const int fgColor, const int bgColor, const T text) {
-      std::cout << "\033[" << bgColor << ";" << fgColor << "m" << text << "\033[" << Color::Default << "m";
-}
-
-void clear() { std::cout << "\x1B[2J\x1B[H"; }
-
-void showRules() {
-      using std::cout, std::endl;
+// Whether readKey would return without waiting.
+bool hasPendingKey(Input *input) { return input->begin != input->end || fillInput(input, 0); }
 
-      cout << "Rules of the game \"Sudoku\":" << endl;
+// Waits up to timeoutMs, or without a limit for -1, for more bytes. Returns whether any came.
+bool fillInput(Input *input, const int timeoutMs) {
+      memmove(input->bytes, input->bytes + input->begin, input->end - input->begin);
+      input->end -= input->begin;
+      input->begin = 0;
 
-      cout << "------------------------------" << endl;
+      if (input->isClosed || input->end == INPUT_BUFFER_SIZE) return false;
 
-      cout << "- Sudoku is played over a 9x9 grid, divided \nto 3x3 sub grids called \"regions\";" << endl;
-      cout << "- Sudoku begins with some of the grid cells \nalready filled with numbers;" << endl;
-      cout << "- The object of Sudoku is to fill the other \nempty cells with numbers between 1 and 9 \n"
-              "according the following guidelines:"
-           << endl;
+      pollfd request = {STDIN_FILENO, POLLIN, 0};
 
-      cout << "1. Number can appear only once on each row;" << endl;
-      cout << "2. Number can appear only once on each column;" << endl;
-      cout << "3. Number can appear only once on each region;\n" << endl;
+      if (poll(&request, 1, timeoutMs) <= 0) return false;
 
-      cout << "Note: you can't change the ";
-      setColor(Color::YellowFg, Color::Default, "generated");
-      cout << " digit;" << endl;
+      ssize_t readCount = read(STDIN_FILENO, input->bytes + input->end, INPUT_BUFFER_SIZE - input->end);
 
-      cout << "------------------------------\n" << endl;
-}
-
-void showMenu(const int countOfCorrectDigitsShown) {
-      using std::cout, std::endl;
-      const int END_COUNT = 81;
-
-      cout << "\nm - show menu;" << endl;
-      cout << "c - close menu;" << endl;
-      cout << "Esc - close the game;\n" << endl;
-
-      cout << "n - create new field;" << endl;
-      cout << "r - reset all changes;" << endl;
-      cout << "h - show hint;\n" << endl;
-
-      cout << "w,a,s,d - moving;" << endl;
-      cout << "1,2...9 - press if you want to change the cell;" << endl;
-      cout << "0 - press if you want to clear inputed digit;\n" << endl;
-
-      cout << "Remains to be filled out: ";
-      setColor(Color::YellowFg, Color::Default, END_COUNT - countOfCorrectDigitsShown);
-      cout << ";" << endl;
-      cout << "Filled in: ";
-      setColor(Color::YellowFg, Color::Default, countOfCorrectDigitsShown);
-      cout << ";\n" << endl;
-
-      cout << "Field info: " << endl;
-      setColor(Color::CyanFg, Color::Default, '*');
-      cout << " or ";
-      setColor(Color::CyanFg, Color::Default, '9');
-      cout << " - current player position;" << endl;
-      setColor(Color::BlackFg, Color::Default, '*');
-      cout << " - empty cell;" << endl;
-      setColor(Color::YellowFg, Color::Default, '9');
-      cout << " - generated digit;" << endl;
-      setColor(Color::RedFg, Color::Default, '9');
-      cout << " - incorrect digit;" << endl;
-      setColor(Color::GreenFg, Color::Default, '9');
-      cout << " - correct digit;" << endl;
-}
+      if (readCount <= 0) {
+            input->isClosed = readCount == 0 || errno != EINTR;
 
-void showHint(int ***solvedMtrx, int ***defaultDigits, const int dimension) {
-      clear();
-      drawField(solvedMtrx, defaultDigits, dimension, -1, -1);
-      setColor(Color::BlackFg, Color::Default, "Press Enter to hide the hint.");
-      getchar();
-      getchar();
-}
-
-void showEndOfGame(const int filledSellsCount) {
-      clear();
-
-      setColor(Color::GreenFg, Color::Default, "Congratulations!");
-      setColor(Color::Default, Color::Default, " You have completed ");
-      setColor(Color::CyanFg, Color::Default, "Sudoku");
-      setColor(Color::Default, Color::Default, " and filled ");
-      setColor(Color::MagentaFg, Color::Default, filledSellsCount);
-      setColor(Color::Default, Color::Default, " empty cells!");
-}
-
-void allocateMtrxs(const int dimension, std::vector<int ***> mtrxPtrs) {
-      for (auto mtrxPtr : mtrxPtrs) {
-            (*mtrxPtr) = new int *[dimension];
-
-            for (int i = 0; i < dimension; i++) *(*mtrxPtr + i) = new int[dimension];
-      }
-}
-
-void freeMtrxs(const int dimension, std::vector<int ***> mtrxPtrs) {
-      for (auto mtrxPtr : mtrxPtrs) {
-            for (int i = 0; i < dimension; i++) delete[] * (*mtrxPtr + i);
-
-            delete[](*mtrxPtr);
+            return false;
       }
-}
-
-Color getFgColor(int ***digits, int ***defaultDigits, const int dimension, const int row, const int col,
-                 const int playerPosX, const int playerPosY) {
-      const int HIDDEN_DIGIT = 0;
-
-      Color result;
-
-      bool isDefaultDigit = *(*(*defaultDigits + row) + col) == *(*(*digits + row) + col);
-      bool isShownDigit = (*(*(*digits + row) + col)) != HIDDEN_DIGIT;
 
-      if (row == playerPosY && col == playerPosX)
-            result = Color::CyanFg;
-      else if (!isEnteredDigitCorrect(digits, dimension, row, col) && !isDefaultDigit && isShownDigit)
-            result = Color::RedFg;
-      else if (isDefaultDigit && isShownDigit)
-            result = Color::YellowFg;
-      else if (!isDefaultDigit)
-            result = Color::GreenFg;
-      else
-            result = Color::BlackFg;
+      input->end += readCount;
 
-      return result;
+      return true;
 }
 
-int getRandomUnusedDigit(int ***mtrxPtr, const int dimension, const int row, const int col) {
-      int randomDigit = 1 + rand() % 9;
-      int initialDigit = randomDigit;
-
-      while (hasDigitInVerticalLine(mtrxPtr, dimension, row, col, randomDigit) ||
-             hasDigitInHorizontalLine(mtrxPtr, dimension, row, col, randomDigit) ||
-             hasDigitInCurrentSection(mtrxPtr, randomDigit, row, col)) {
-            randomDigit = randomDigit < 9 ? randomDigit + 1 : 1;
-
-            if (initialDigit == randomDigit) {
-                  randomDigit = -1;
-
-                  break;
+// Shows the next step on the field: the cell is marked and, once the hint is closed, the player
+// is moved there. Digits which differ from the solution are shown as incorrect.
+template <int SECTION_LEN>
+void showHint(Screen *screen, Input *input, BasicBoard<SECTION_LEN> *currentDigits,
+              BasicBoard<SECTION_LEN> *defaultDigits, BasicBoard<SECTION_LEN> *solvedMtrx,
+              const Progress<SECTION_LEN> *progress, const int dimension, int *playerPosX, int *playerPosY) {
+      const int ESC = '\x1B';
+      const Color TEXT = Color::BlackFg;
+
+      Hint hint;
+      findHint(currentDigits, solvedMtrx, &hint);
+
+      Progress<SECTION_LEN> hintProgress = *progress;
+
+      for (int cell = 0; cell < dimension * dimension; cell++)
+            if (isMistakenCell(currentDigits, solvedMtrx, cell)) hintProgress.conflictsCounts[cell]++;
+
+      const int hintRow = hint.cell == -1 ? -1 : hint.cell / dimension;
+      const int hintCol = hint.cell == -1 ? -1 : hint.cell % dimension;
+
+      clearScreen(screen);
+      drawField(screen, currentDigits, defaultDigits, &hintProgress, dimension, hintCol, hintRow);
+      putText(screen, TEXT, Color::Default, "\n");
+
+      if (hint.cell == -1) {
+            putText(screen, TEXT, Color::Default, "The field is solved.\n");
+      } else {
+            if (hint.mistakesCount != 0) {
+                  putText(screen, TEXT, Color::Default, "Your digits which don't match the solution: ");
+                  putText(screen, Color::RedFg, Color::Default, hint.mistakesCount);
+                  putText(screen, TEXT, Color::Default, ".\n");
             }
-      }
-
-      return randomDigit;
-}
-
-int getCountOfShownDigits(int ***defaultDigits, const int dimension) {
-      int result = 0;
-      const int HIDDEN_DIGIT = 0;
-
-      for (int i = 0; i < dimension; i++)
-            for (int j = 0; j < dimension; j++)
-                  result = *(*(*defaultDigits + i) + j) != HIDDEN_DIGIT ? result + 1 : result;
-
-      return result;
-}
-
-bool hasDigitInHorizontalLine(int ***mtrx, const int dimension, const int row, const int col,
-                              const int digit) {
-      bool has = false;
-
-      for (int i = 0; !has && i < dimension; i++) {
-            if (i == col) continue;
-
-            if (*(*(*mtrx + row) + i) == digit) has = true;
-      }
 
-      return has;
-}
-
-bool hasDigitInVerticalLine(int ***mtrx, const int dimension, const int row, const int col, const int digit) {
-      bool has = false;
-
-      for (int i = 0; !has && i < dimension; i++) {
-            if (i == row) continue;
+            putText(screen, TEXT, Color::Default, "Row ");
+            putText(screen, TEXT, Color::Default, hintRow + 1);
+            putText(screen, TEXT, Color::Default, ", column ");
+            putText(screen, TEXT, Color::Default, hintCol + 1);
+            putText(screen, TEXT, Color::Default, hint.mistakesCount != 0 ? " should be " : " is ");
+            putGlyph(screen, Color::GreenFg, Color::Default, getDigitChar(hint.digit));
+
+            if (hint.mistakesCount == 0 && hint.technique != REVEALING_STEP) {
+                  putText(screen, TEXT, Color::Default, ", found by ");
+                  putText(screen, Color::CyanFg, Color::Default, TECHNIQUE_NAMES[hint.technique]);
+            } else if (hint.mistakesCount == 0) {
+                  putText(screen, TEXT, Color::Default, ": no technique of the hint gets further");
+            }
 
-            if (*(*(*mtrx + i) + col) == digit) has = true;
+            putText(screen, TEXT, Color::Default, ".\n");
       }
 
-      return has;
-}
-
-bool hasDigitInCurrentSection(int ***mtrx, const int digit, const int row, const int col) {
-      const int SECTION_LEN = 3;
-
-      bool has = false;
+      putText(screen, TEXT, Color::Default, "Press Enter to hide the hint.");
+      presentScreen(screen);
 
-      int startIndexOfSectionRow = SECTION_LEN * (row / SECTION_LEN);
-      int startIndexOfSectionCol = SECTION_LEN * (col / SECTION_LEN);
+      // Esc hides the hint as well, and a closed input reads as Esc.
+      int key;
 
-      for (int i = startIndexOfSectionRow; !has && i < SECTION_LEN + startIndexOfSectionRow; i++) {
-            for (int j = startIndexOfSectionCol; !has && j < SECTION_LEN + startIndexOfSectionCol; j++) {
-                  if (i == row && j == col) continue;
+      do {
+            key = readKey(input);
+      } while (key != '\n' && key != '\r' && key != ESC);
 
-                  if (*(*(*mtrx + i) + j) == digit) has = true;
-            }
+      if (hint.cell != -1) {
+            *playerPosX = hintCol;
+            *playerPosY = hintRow;
       }
-
-      return has;
-}
-
-bool isDefaultDigit(int ***currentDigits, int ***defaultDigits, const int row, const int col) {
-      return (*(*(*currentDigits + row) + col) == *(*(*defaultDigits + row) + col)) &&
-             (*(*(*defaultDigits + row) + col) != 0);
-}
-
-bool isEnteredDigitCorrect(int ***digits, const int dimension, const int row, const int col) {
-      return !((hasDigitInHorizontalLine(digits, dimension, row, col, *(*(*digits + row) + col)) ||
-                hasDigitInVerticalLine(digits, dimension, row, col, *(*(*digits + row) + col))) ||
-               hasDigitInCurrentSection(digits, *(*(*digits + row) + col), row, col));
 }
@@ -0,0 +1,2110 @@
+// sudoku.h - engine of the console game: fields, generation, solving, grading and drawing
+#ifndef SUDOKU_H
+#define SUDOKU_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum Color {
+      BlackFg = 90,
+      BlackBg = 40,
+      RedFg = 31,
+      RedBg = 41,
+      GreenFg = 32,
+      GreenBg = 42,
+      YellowFg = 33,
+      YellowBg = 43,
+      MagentaFg = 35,
+      MagentaBg = 45,
+      CyanFg = 36,
+      CyanBg = 46,
+      Default = 0
+};
+
+const int BOARD_DIMENSION = 9;
+const int BOARD_SECTION_LEN = 3;
+const int BOARD_CELLS_COUNT = BOARD_DIMENSION * BOARD_DIMENSION;
+const int ROW_UNIT = 0, COL_UNIT = 1, SECTION_UNIT = 2;
+const int UNIT_KINDS_COUNT = 3;
+const uint16_t ALL_DIGITS_MASK = (1 << BOARD_DIMENSION) - 1;
+
+// Sizes of a field whose sections are SECTION_LEN x SECTION_LEN cells, with the digits
+// 1..DIMENSION. The game, the generator and the solver are templates over the section length;
+// grading, Dancing Links and the batch modes work on the classic 9x9 field only.
+template <int SECTION_LEN>
+struct BoardSize {
+      static constexpr int DIMENSION = SECTION_LEN * SECTION_LEN;
+      static constexpr int CELLS_COUNT = DIMENSION * DIMENSION;
+      static constexpr int UNITS_COUNT = UNIT_KINDS_COUNT * DIMENSION;
+      static constexpr int PEERS_COUNT = 2 * (DIMENSION - 1) + (SECTION_LEN - 1) * (SECTION_LEN - 1);
+
+      // A bit per digit, in the narrowest type which holds them all.
+      using Mask = std::conditional_t<DIMENSION <= 16, uint16_t, uint32_t>;
+
+      static constexpr Mask ALL_DIGITS_MASK = (Mask)((1ull << DIMENSION) - 1);
+};
+
+// Row, column and section of every cell, the cells of every unit and the peers of every cell,
+// built at compile time so the hot loops look them up instead of dividing and skipping the cell
+// itself. Units are numbered rows first, then columns, then sections, as in
+// SolverState::usedMasks; a section lists its cells row by row. The peers are the PEERS_COUNT
+// cells (20 on the 9x9 field) sharing a row, a column or a section with the cell.
+template <int SECTION_LEN>
+struct CellLayout {
+      using Size = BoardSize<SECTION_LEN>;
+
+      uint8_t cellRows[Size::CELLS_COUNT];
+      uint8_t cellCols[Size::CELLS_COUNT];
+      uint8_t cellSections[Size::CELLS_COUNT];
+      uint16_t unitCells[Size::UNITS_COUNT][Size::DIMENSION];
+      uint16_t peerCells[Size::CELLS_COUNT][Size::PEERS_COUNT];
+};
+
+template <int SECTION_LEN>
+constexpr CellLayout<SECTION_LEN> makeCellLayout() {
+      const int DIMENSION = BoardSize<SECTION_LEN>::DIMENSION;
+
+      CellLayout<SECTION_LEN> layout{};
+
+      for (int row = 0; row < DIMENSION; row++) {
+            for (int col = 0; col < DIMENSION; col++) {
+                  const int cell = row * DIMENSION + col;
+                  const int section = SECTION_LEN * (row / SECTION_LEN) + col / SECTION_LEN;
+                  const int indexInSection = SECTION_LEN * (row % SECTION_LEN) + col % SECTION_LEN;
+                  const int startRow = SECTION_LEN * (row / SECTION_LEN);
+                  const int startCol = SECTION_LEN * (col / SECTION_LEN);
+
+                  layout.cellRows[cell] = row;
+                  layout.cellCols[cell] = col;
+                  layout.cellSections[cell] = section;
+
+                  layout.unitCells[ROW_UNIT * DIMENSION + row][col] = cell;
+                  layout.unitCells[COL_UNIT * DIMENSION + col][row] = cell;
+                  layout.unitCells[SECTION_UNIT * DIMENSION + section][indexInSection] = cell;
+
+                  int count = 0;
+
+                  for (int i = 0; i < DIMENSION; i++) {
+                        if (i != col) layout.peerCells[cell][count++] = row * DIMENSION + i;
+                        if (i != row) layout.peerCells[cell][count++] = i * DIMENSION + col;
+                  }
+
+                  for (int i = startRow; i < startRow + SECTION_LEN; i++)
+                        for (int j = startCol; j < startCol + SECTION_LEN; j++)
+                              if (i != row && j != col) layout.peerCells[cell][count++] = i * DIMENSION + j;
+            }
+      }
+
+      return layout;
+}
+
+template <int SECTION_LEN>
+constexpr CellLayout<SECTION_LEN> CELL_LAYOUT = makeCellLayout<SECTION_LEN>();
+
+
+// Flat row-major storage of the whole field, 0 is a hidden cell. Trivially copyable, so
+// boards live on the stack and are copied with a single memcpy.
+//
+// Besides the digits the board keeps the constraint state of every row, column and section:
+// bit (digit - 1) of usedMasks is set while the digit occurs in the unit at least once and of
+// conflictMasks while it occurs twice or more. Both are kept in sync by setDigit.
+template <int SECTION_LEN>
+struct BasicBoard {
+      using Size = BoardSize<SECTION_LEN>;
+      using Mask = typename Size::Mask;
+
+      uint8_t digits[Size::CELLS_COUNT];
+      Mask usedMasks[UNIT_KINDS_COUNT][Size::DIMENSION];
+      Mask conflictMasks[UNIT_KINDS_COUNT][Size::DIMENSION];
+      uint8_t digitCounts[UNIT_KINDS_COUNT][Size::DIMENSION][Size::DIMENSION];
+};
+
+using Board = BasicBoard<BOARD_SECTION_LEN>;
+
+const int UNITS_COUNT = UNIT_KINDS_COUNT * BOARD_DIMENSION;
+
+// Search state of the solver: digits plus the used digits of every unit, where units are numbered
+// rows first, then columns, then sections. Copied on every guess, so it's kept small.
+template <int SECTION_LEN>
+struct SolverState {
+      using Size = BoardSize<SECTION_LEN>;
+
+      uint8_t digits[Size::CELLS_COUNT];
+      typename Size::Mask usedMasks[Size::UNITS_COUNT];
+      int hiddenCount;
+};
+
+enum SolverBackend { Bitmask, DancingLinks };
+
+// How the 9x9 bitmask solver propagates singles: cell by cell, or over whole rows of candidates at
+// once in SSE2 or AVX2 registers.
+enum PropagationKernel { Scalar, Sse2, Avx2, PROPAGATION_KERNELS_COUNT };
+
+const char *const PROPAGATION_KERNEL_NAMES[] = {"scalar", "sse2", "avx2"};
+
+// xoshiro256** generator. Every generator owns one, so there is no hidden shared state: a puzzle is
+// fully determined by the (seed, stream) pair its generator was seeded with, and generators on
+// different threads never contend.
+struct Random {
+      uint64_t state[4];
+};
+
+enum Difficulty { Easy, Medium, Hard, DIFFICULTIES_COUNT };
+
+// Human solving techniques in the order the grader tries them, cheapest first.
+enum Technique {
+      HiddenSingle,
+      NakedSingle,
+      LockedCandidates,
+      NakedPair,
+      HiddenPair,
+      NakedTriple,
+      XWing,
+      HiddenTriple,
+      Swordfish,
+      TECHNIQUES_COUNT
+};
+
+const int TECHNIQUE_COSTS[TECHNIQUES_COUNT] = {10, 15, 20, 30, 35, 40, 45, 50, 55};
+const char *const TECHNIQUE_NAMES[TECHNIQUES_COUNT] = {
+    "hidden-single", "naked-single", "locked-candidates", "naked-pair", "hidden-pair",
+    "naked-triple",  "x-wing",       "hidden-triple",     "swordfish"};
+const int MAX_RATING = 100;  // the techniques above aren't enough, the puzzle needs guessing
+
+// Ratings of the difficulties, for puzzles taken from a database: singles only; locked candidates
+// and pairs; anything harder.
+const int DIFFICULTY_RATING_BANDS[DIFFICULTIES_COUNT][2] = {{0, 15}, {20, 35}, {40, MAX_RATING}};
+
+// Candidates of every hidden cell, narrowed down by the techniques of the grader.
+struct GradingState {
+      uint8_t digits[BOARD_CELLS_COUNT];
+      uint16_t candidates[BOARD_CELLS_COUNT];
+      int hiddenCount;
+      bool isContradictory;
+};
+
+// The rating of a puzzle is the cost of the hardest technique its logical solution needed.
+struct Grade {
+      int rating;
+      int stepsCount;
+      uint16_t usedTechniques;
+      bool isSolved;
+};
+
+const int REVEALING_STEP = TECHNIQUES_COUNT;  // the digit is taken from the solution
+const char *const REVEALING_STEP_NAME = "solution";
+
+// Next step for the player: the first of mistakesCount digits which differ from the solution, or
+// else a hidden cell, its digit and the hardest technique needed to find it. cell is -1 when the
+// field is full and correct.
+struct Hint {
+      int cell, digit;
+      int technique;
+      int mistakesCount;
+};
+
+struct GenerateOptions {
+      uint64_t count;
+      uint64_t firstIndex;
+      uint64_t seed;
+      int threadsCount;
+      Difficulty difficulty;
+      int minRating, maxRating;
+      int targetCluesCount;
+      bool isMinimal, isSymmetric;
+      const char *outputPath;
+      const char *dbPath;
+      bool isBinary, isDistinct;
+      PropagationKernel kernel;
+      int statsMode;
+      const char *tracePath;
+};
+
+enum SolveStatus { Unique, Multiple, Unsolvable, Invalid, Mismatch, SOLVE_STATUSES_COUNT };
+
+const char *const SOLVE_STATUS_NAMES[] = {"unique", "multiple", "unsolvable", "invalid", "mismatch"};
+
+struct SolveOptions {
+      const char *inputPath;
+      const char *outputPath;
+      int threadsCount;
+      SolverBackend backend;
+      bool isCrossChecked;
+      bool isGraded, isHinted;
+      PropagationKernel kernel;
+      int statsMode;
+      const char *tracePath;
+};
+
+// One puzzle of the input: the text of its line and, once solved, the outcome.
+struct SolveTask {
+      const char *line;
+      int lineLength;
+      SolveStatus status;
+      float microseconds;
+      Grade grade;
+      Hint hint;
+      uint8_t solution[BOARD_CELLS_COUNT];
+};
+
+const char PUZZLE_DB_MAGIC[8] = {'S', 'U', 'D', 'O', 'K', 'U', 'D', 'B'};
+const uint32_t PUZZLE_DB_VERSION = 1;
+const int PACKED_CELLS_SIZE = (BOARD_CELLS_COUNT + 1) / 2;
+const int GIVENS_MASK_SIZE = (BOARD_CELLS_COUNT + 7) / 8;
+
+// Puzzle of a database: its solution, a cell per nibble as in generate --binary, and a bit per
+// cell which the puzzle shows.
+struct PuzzleDbRecord {
+      uint8_t solution[PACKED_CELLS_SIZE];
+      uint8_t givens[GIVENS_MASK_SIZE];
+};
+
+// Start of a puzzle database file, in host byte order. The records follow it, sorted by rating:
+// the records rated r are [ratingStarts[r], ratingStarts[r + 1]), so any band of ratings is one
+// contiguous range.
+struct PuzzleDbHeader {
+      char magic[8];
+      uint32_t version;
+      uint32_t recordSize;
+      uint64_t recordsCount;
+      uint64_t ratingStarts[MAX_RATING + 2];
+};
+
+// Database mapped into memory and read in place.
+struct PuzzleDb {
+      const char *data;
+      size_t size;
+      const PuzzleDbHeader *header;
+      const PuzzleDbRecord *records;
+};
+
+struct PackOptions {
+      const char *inputPath;
+      const char *outputPath;
+      int threadsCount;
+};
+
+struct UnpackOptions {
+      const char *inputPath;
+      const char *outputPath;
+      int minRating, maxRating;
+};
+
+struct ServeOptions {
+      const char *socketPath;
+      const char *dbPath;
+      const char *tracePath;
+      uint64_t seed;
+      int threadsCount;
+      int maxSessionsCount;
+      int statsMode;
+};
+
+// Generated puzzle on its way from a worker to the writer, which puts it back in index order.
+struct PuzzleRecord {
+      uint64_t index;
+      uint8_t digits[BOARD_CELLS_COUNT];
+};
+
+// Puzzles the writer of generate holds while it waits for an earlier one; workers claim no index
+// past the window, so a slow puzzle holds up at most this many.
+const uint64_t REORDER_WINDOW_SIZE = 1 << 14;
+
+// Tries of generate at one index before it gives up on the run: over a hundred times the mean of the
+// rarest band of ratings, so only a band no puzzle meets, or --distinct out of puzzles, gets there.
+const uint64_t MAX_GENERATE_ATTEMPTS_COUNT = 1 << 18;
+const uint64_t NO_FAILED_INDEX = UINT64_MAX;
+
+struct PuzzleQueueSlot {
+      std::atomic<uint64_t> sequence;
+      PuzzleRecord record;
+};
+
+// Bounded lock-free multi-producer multi-consumer ring (Vyukov's array queue): the sequence of a
+// slot tells whether it is free for the producer of the given turn or filled for its consumer.
+// Capacity is a power of two.
+struct PuzzleQueue {
+      PuzzleQueueSlot *slots;
+      uint64_t mask;
+      alignas(64) std::atomic<uint64_t> tail;
+      alignas(64) std::atomic<uint64_t> head;
+};
+
+const int PERMUTATIONS_OF_3[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+
+// Transformation of a puzzle on its way to the canonical form, fixed row by row: the rows taken
+// so far, the original column of every column and the new names of the digits met so far.
+struct CanonicalState {
+      uint8_t columns[BOARD_DIMENSION];
+      uint8_t labels[BOARD_DIMENSION + 1];
+      uint8_t nextLabel;
+      uint8_t band;
+      uint16_t usedRows;
+      bool isTransposed;
+};
+
+// Working memory of canonicalizePuzzle, kept between the puzzles of a thread.
+struct Canonicalizer {
+      std::vector<CanonicalState> states, nextStates;
+};
+
+const int DISTINCT_SHARD_BITS = 6;
+const int DISTINCT_SHARDS_COUNT = 1 << DISTINCT_SHARD_BITS;
+const uint64_t MAX_DISTINCT_PUZZLES_COUNT = 1 << 26;
+const uint64_t EMPTY_DISTINCT_SLOT = 0;
+
+// Open-addressing table of canonical hashes with linear probing, filled with compare-and-swap.
+struct DistinctSetShard {
+      std::atomic<uint64_t> *slots;
+      uint64_t mask;
+};
+
+// Hashes of the puzzles emitted so far, split into shards by the top bits of the hash so that
+// threads rarely probe the same cache lines. Its size is fixed up front from the number of
+// puzzles, at 16 bytes per puzzle.
+struct DistinctSet {
+      DistinctSetShard shards[DISTINCT_SHARDS_COUNT];
+      std::atomic<uint64_t> duplicatesCount;
+};
+
+const uint32_t PUZZLE_RING_CAPACITY = 4;  // a power of two
+
+template <int SECTION_LEN>
+struct PooledPuzzle {
+      BasicBoard<SECTION_LEN> puzzle, solution;
+};
+
+// Bounded lock-free single-producer single-consumer ring: only the producer moves tail and only
+// the consumer moves head, and the slots between them are the consumer's.
+template <int SECTION_LEN>
+struct PuzzleRing {
+      PooledPuzzle<SECTION_LEN> puzzles[PUZZLE_RING_CAPACITY];
+      alignas(64) std::atomic<uint32_t> tail;
+      alignas(64) std::atomic<uint32_t> head;
+};
+
+// Puzzles generated ahead by a background thread, a ring for every difficulty in difficultiesMask,
+// so a new field is a pop and a copy. The producer sleeps while the rings are full; every pop
+// wakes it. Hits and misses count the pops which found a puzzle ready and which didn't.
+template <int SECTION_LEN>
+struct PuzzlePool {
+      PuzzleRing<SECTION_LEN> rings[DIFFICULTIES_COUNT];
+      uint32_t difficultiesMask;
+      Random random;
+      std::thread producer;
+      std::mutex mutex;
+      std::condition_variable wakeUp;
+      std::atomic<bool> isStopping;
+      uint64_t hitsCount, missesCount;
+};
+
+const int DLX_CONSTRAINTS_COUNT = 4;  // cell, row-digit, column-digit, section-digit
+const int DLX_COLUMNS_COUNT = DLX_CONSTRAINTS_COUNT * BOARD_CELLS_COUNT;
+const int DLX_ROWS_COUNT = BOARD_CELLS_COUNT * BOARD_DIMENSION;
+const int DLX_NODES_COUNT = 1 + DLX_COLUMNS_COUNT + DLX_CONSTRAINTS_COUNT * DLX_ROWS_COUNT;
+
+// Exact-cover matrix of Sudoku for Algorithm X. Node 0 is the root, nodes 1..324 are the column
+// headers and every candidate (cell, digit) owns four consecutive nodes after them. The matrix is
+// built once; a puzzle selects the rows of its shown digits and unselects them when done, so the
+// arena is reused between puzzles without any allocation.
+struct DlxArena {
+      int16_t left[DLX_NODES_COUNT], right[DLX_NODES_COUNT];
+      int16_t up[DLX_NODES_COUNT], down[DLX_NODES_COUNT];
+      int16_t column[DLX_NODES_COUNT];
+      int16_t size[1 + DLX_COLUMNS_COUNT];
+      int16_t chosenRows[BOARD_CELLS_COUNT];
+      int chosenCount;
+};
+
+// Running correctness of the shown digits of the field. conflictsCounts holds for every cell how
+// many of its peers show the same digit; a shown cell is correct while it has no conflicts or is
+// generated. Kept up to date by updateProgress, so a move touches only the peers of one cell.
+template <int SECTION_LEN>
+struct Progress {
+      uint8_t conflictsCounts[BoardSize<SECTION_LEN>::CELLS_COUNT];
+      int correctDigitsCount;
+};
+
+// State of one game: the field, the player's cursor and counters, and the generator of its next
+// fields. The terminal game plays one; the server keeps one per connection, so it's flat and small.
+template <int SECTION_LEN>
+struct GameSession {
+      BasicBoard<SECTION_LEN> defaultDigits, currentDigits, solvedMtrx;
+      Progress<SECTION_LEN> progress;
+      Random random;
+      int playerPosX, playerPosY;
+      int initialDigitsShownCount;
+      bool isMenuShown;
+};
+
+// What the keys of the game do to its session; the commands of the server map to the same actions.
+enum SessionAction {
+      MoveUp,
+      MoveDown,
+      MoveLeft,
+      MoveRight,
+      PutDigit,
+      ClearDigit,
+      ResetField,
+      NewField,
+      ShowMenu,
+      HideMenu
+};
+
+const int SCREEN_WIDTH = 80;
+
+// Glyph and colors of one position of the terminal.
+struct ScreenCell {
+      char glyph;
+      uint8_t fgColor;
+      uint8_t bgColor;
+};
+
+// The game composes every frame into cells, rowsCount rows of SCREEN_WIDTH, and presentScreen sends
+// the terminal only the cells which differ from shownCells, the previous frame, with one write().
+// row and col are where the next glyph goes.
+struct Screen {
+      std::vector<ScreenCell> cells, shownCells;
+      int rowsCount, shownRowsCount;
+      int row, col;
+      bool isShown;
+      std::vector<char> output;
+};
+
+// Counters and timers of the hot paths, reported by --stats and traced by --trace. A build with
+// SUDOKU_STATS 0 compiles them out; otherwise they cost a test of statsMode until an option sets it.
+#ifndef SUDOKU_STATS
+#define SUDOKU_STATS 1
+#endif
+
+const int STATS_REPORTED = 1, STATS_TRACED = 2;
+
+enum StatCounter {
+      FillBacktracks,
+      FillRestarts,
+      HideChecks,
+      HiddenDigits,
+      MinimizeChecks,
+      ProgressUpdates,
+      FramesPresented,
+      KeysRead,
+      ServerSessions,
+      ServerCommands,
+      STAT_COUNTERS_COUNT
+};
+
+const char *const STAT_COUNTER_NAMES[STAT_COUNTERS_COUNT] = {
+    "fill.backtracks", "fill.restarts",    "hide.uniqueness-checks", "hide.hidden-digits",
+    "minimize.checks", "progress.updates", "screen.frames",          "input.keys",
+    "server.sessions", "server.commands"};
+
+enum StatHistogram {
+      FillTime,
+      HideTime,
+      MinimizeTime,
+      SolveTime,
+      ActionTime,
+      DrawTime,
+      PresentTime,
+      FrameBytes,
+      KeyLatency,
+      CommandTime,
+      STAT_HISTOGRAMS_COUNT
+};
+
+const char *const STAT_HISTOGRAM_NAMES[STAT_HISTOGRAMS_COUNT] = {
+    "generate.fill", "generate.hide",  "generate.minimize",  "solve.puzzle",      "input.action",
+    "screen.draw",   "screen.present", "screen.frame-bytes", "input.key-latency", "server.command"};
+const bool IS_STAT_HISTOGRAM_TIMED[STAT_HISTOGRAMS_COUNT] = {true, true, true,  true, true,
+                                                              true, true, false, true, true};
+
+// Log-linear buckets: values below 16 exactly, then 8 buckets per power of two, so a percentile is
+// off by less than 1/8.
+const int STAT_SUB_BUCKET_BITS = 3;
+const int STAT_EXACT_VALUES_COUNT = 2 << STAT_SUB_BUCKET_BITS;
+const int STAT_BUCKETS_COUNT = STAT_EXACT_VALUES_COUNT + (64 - 4) * (1 << STAT_SUB_BUCKET_BITS);
+const size_t MAX_TRACE_EVENTS_COUNT = 1 << 20;  // per thread
+
+struct Histogram {
+      uint64_t bucketCounts[STAT_BUCKETS_COUNT];
+      uint64_t count, sum, min, max;
+};
+
+// A timed section, or a value for the untimed histograms, in nanoseconds since the stats started.
+struct TraceEvent {
+      uint64_t startNs, value;
+      StatHistogram histogram;
+};
+
+// Stats of one thread, written by it alone and added up with the ones of the other threads when
+// reported, once they are done.
+struct StatsShard {
+      int threadIndex;
+      uint64_t counts[STAT_COUNTERS_COUNT];
+      Histogram histograms[STAT_HISTOGRAMS_COUNT];
+      std::vector<TraceEvent> events;
+      uint64_t droppedEventsCount;
+};
+
+template <int SECTION_LEN>
+void initDigits(BasicBoard<SECTION_LEN> *defaultDigitsPtr, BasicBoard<SECTION_LEN> *solvedDigitsPtr,
+                BasicBoard<SECTION_LEN> *currentDigitsPtr, const PuzzleDb *db, PuzzlePool<SECTION_LEN> *pool,
+                Random *random);
+template <int SECTION_LEN>
+void generatePuzzle(BasicBoard<SECTION_LEN> *puzzle, BasicBoard<SECTION_LEN> *solution,
+                    const Difficulty difficulty, Random *random);
+template <int SECTION_LEN>
+void generateMinimalPuzzle(BasicBoard<SECTION_LEN> *puzzle, BasicBoard<SECTION_LEN> *solution,
+                           const int targetCluesCount, const bool isSymmetric, Random *random);
+
+int runGenerateMode(int argc, char *argv[]);
+bool parseGenerateOptions(int argc, char *argv[], GenerateOptions *options);
+bool parseUnsignedOption(const char *text, uint64_t *value);
+bool parseDifficulty(const char *text, Difficulty *difficulty);
+bool parseRatingBand(const char *text, int *minRating, int *maxRating);
+void generatePuzzlesInWorker(const GenerateOptions *options, const PuzzleDb *db, DistinctSet *distinctSet,
+                             std::atomic<uint64_t> *nextIndex, const std::atomic<uint64_t> *writtenIndex,
+                             std::atomic<uint64_t> *failedIndex, PuzzleQueue *queue);
+bool writeGeneratedPuzzles(const GenerateOptions *options, PuzzleQueue *queue,
+                           std::atomic<uint64_t> *writtenIndex, const std::atomic<uint64_t> *failedIndex,
+                           FILE *output);
+int formatPuzzleRecord(const PuzzleRecord *record, const bool isBinary, char *buffer);
+
+int runSolveMode(int argc, char *argv[]);
+bool parseSolveOptions(int argc, char *argv[], SolveOptions *options);
+bool loadInput(const char *path, const char **data, size_t *size, std::vector<char> *stdinData);
+bool mapInputFile(const char *path, const char **data, size_t *size);
+bool readWholeStream(int fd, std::vector<char> *data);
+size_t collectSolveTasks(const char *data, const size_t size, size_t offset, std::vector<SolveTask> *tasks);
+void solveTaskBatch(const SolveOptions *options, std::vector<SolveTask> *tasks);
+void solvePuzzlesInWorker(const SolveOptions *options, std::vector<SolveTask> *tasks,
+                          std::atomic<size_t> *nextTask);
+void solveTask(const SolveOptions *options, SolveTask *task);
+bool parsePuzzleLine(const char *line, const int length, Board *puzzle);
+void appendSolveTask(const SolveTask *task, std::vector<char> *output);
+
+int runPackMode(int argc, char *argv[]);
+bool parsePackOptions(int argc, char *argv[], PackOptions *options);
+bool writeRecordGroup(int fd, std::vector<PuzzleDbRecord> *group, uint64_t *nextRecord);
+int runUnpackMode(int argc, char *argv[]);
+bool parseUnpackOptions(int argc, char *argv[], UnpackOptions *options);
+bool openPuzzleDb(const char *path, PuzzleDb *db);
+void closePuzzleDb(PuzzleDb *db);
+void getDbRatingRange(const PuzzleDb *db, const int minRating, const int maxRating, uint64_t *first,
+                      uint64_t *end);
+bool takeDbPuzzle(const PuzzleDb *db, const int minRating, const int maxRating, Random *random, Board *puzzle,
+                  Board *solution);
+void packDbRecord(const Board *puzzle, const uint8_t *solutionDigits, PuzzleDbRecord *record);
+void unpackDbRecord(const PuzzleDbRecord *record, uint8_t *puzzleDigits, uint8_t *solutionDigits);
+
+int runServeMode(int argc, char *argv[]);
+bool parseServeOptions(int argc, char *argv[], ServeOptions *options);
+void raiseOpenFilesLimit();
+uint64_t canonicalizePuzzle(const Board *puzzle, Canonicalizer *canonicalizer, uint8_t *canonicalDigits);
+void addFirstCanonicalRows(const uint8_t *digits, const bool isTransposed, const int row,
+                           std::vector<CanonicalState> *states, int *bestMask);
+void addNextCanonicalRow(const uint8_t *digits, const CanonicalState *state, const int row, uint8_t *bestRow,
+                         bool *isBestFound, std::vector<CanonicalState> *nextStates);
+void initDistinctSet(DistinctSet *set, const uint64_t puzzlesCount);
+void freeDistinctSet(DistinctSet *set);
+bool insertDistinctPuzzle(DistinctSet *set, uint64_t hash);
+
+void initPuzzleQueue(PuzzleQueue *queue, const uint64_t capacity);
+void freePuzzleQueue(PuzzleQueue *queue);
+bool tryPushPuzzle(PuzzleQueue *queue, const PuzzleRecord *record);
+bool tryPopPuzzle(PuzzleQueue *queue, PuzzleRecord *record);
+
+template <int SECTION_LEN>
+void startPuzzlePool(PuzzlePool<SECTION_LEN> *pool, const uint64_t seed, const uint32_t difficultiesMask);
+template <int SECTION_LEN>
+void stopPuzzlePool(PuzzlePool<SECTION_LEN> *pool);
+template <int SECTION_LEN>
+void producePooledPuzzles(PuzzlePool<SECTION_LEN> *pool);
+template <int SECTION_LEN>
+int findRingToFill(PuzzlePool<SECTION_LEN> *pool);
+template <int SECTION_LEN>
+bool takePooledPuzzle(PuzzlePool<SECTION_LEN> *pool, const Difficulty difficulty,
+                      BasicBoard<SECTION_LEN> *puzzle, BasicBoard<SECTION_LEN> *solution);
+template <int SECTION_LEN>
+void drawField(Screen *screen, BasicBoard<SECTION_LEN> *digits, BasicBoard<SECTION_LEN> *defaultDigits,
+               const Progress<SECTION_LEN> *progress, const int dimension, const int playerPosX,
+               const int playerPosY);
+template <int SECTION_LEN>
+void setCountOfCorrectDigitsShown(int &countOfCorrectDigitsShown, const Progress<SECTION_LEN> *progress);
+
+template <int SECTION_LEN>
+void resetProgress(Progress<SECTION_LEN> *progress, BasicBoard<SECTION_LEN> *digits,
+                   BasicBoard<SECTION_LEN> *defaultDigits);
+template <int SECTION_LEN>
+void updateProgress(Progress<SECTION_LEN> *progress, BasicBoard<SECTION_LEN> *digits,
+                    BasicBoard<SECTION_LEN> *defaultDigits, const int row, const int col, const int digit);
+template <int SECTION_LEN>
+void changeConflictsCount(Progress<SECTION_LEN> *progress, BasicBoard<SECTION_LEN> *defaultDigits,
+                          const int cell, const int delta);
+template <int SECTION_LEN>
+bool isCellCorrect(const Progress<SECTION_LEN> *progress, BasicBoard<SECTION_LEN> *defaultDigits,
+                   const int cell);
+
+template <int SECTION_LEN>
+int fillMtrxOfRandomDigitsFully(BasicBoard<SECTION_LEN> *mtrxPtr, const int dimension, Random *random);
+template <int SECTION_LEN>
+int fillMtrxByMostConstrainedCells(BasicBoard<SECTION_LEN> *mtrxPtr, Random *random);
+template <int SECTION_LEN>
+void hideAnyRandomDigits(BasicBoard<SECTION_LEN> *digitsPtr, const Difficulty difficulty, Random *random);
+template <int SECTION_LEN>
+void hideDigitsInThisSection(BasicBoard<SECTION_LEN> *digitPtr, const BasicBoard<SECTION_LEN> *solution,
+                             SolverState<SECTION_LEN> *cluesState, int amountOfHiddenDigits,
+                             const int startRow, const int startCol, Random *random);
+template <int SECTION_LEN>
+int removeCluesToMinimum(BasicBoard<SECTION_LEN> *puzzle, const BasicBoard<SECTION_LEN> *solution,
+                         const int targetCluesCount, const bool isSymmetric, Random *random);
+template <int SECTION_LEN>
+bool isRemovalUnique(const SolverState<SECTION_LEN> *cluesState, const BasicBoard<SECTION_LEN> *solution,
+                     const int *cells, const int cellsCount);
+
+void seedRandom(Random *random, const uint64_t seed, const uint64_t stream);
+uint64_t getNextRandom(Random *random);
+int getRandomInt(Random *random, const int bound);
+uint64_t getRandomIndex(Random *random, const uint64_t bound);
+uint64_t getSplitMix64(uint64_t *state);
+uint64_t rotateLeft(const uint64_t value, const int shift);
+
+template <int SECTION_LEN>
+bool solve(const BasicBoard<SECTION_LEN> *puzzle, BasicBoard<SECTION_LEN> *solution,
+           const SolverBackend backend = SolverBackend::Bitmask);
+template <int SECTION_LEN>
+int countSolutions(const BasicBoard<SECTION_LEN> *puzzle, const int limit,
+                   const SolverBackend backend = SolverBackend::Bitmask);
+template <int SECTION_LEN>
+int findSolutions(const BasicBoard<SECTION_LEN> *puzzle, const int limit,
+                  BasicBoard<SECTION_LEN> *firstSolution,
+                  const SolverBackend backend);
+template <int SECTION_LEN>
+bool initSolverState(SolverState<SECTION_LEN> *state, const BasicBoard<SECTION_LEN> *puzzle);
+template <int SECTION_LEN>
+void searchSolutions(SolverState<SECTION_LEN> state, const int limit, int *solutionsCount,
+                     SolverState<SECTION_LEN> *firstSolution, const uint8_t *preferredDigits = nullptr,
+                     int *nodesLeft = nullptr);
+template <int SECTION_LEN>
+bool propagateSingles(SolverState<SECTION_LEN> *state);
+bool propagateBoardSingles(SolverState<BOARD_SECTION_LEN> *state);
+bool propagateSinglesWithSse2(SolverState<BOARD_SECTION_LEN> *state);
+bool propagateSinglesWithAvx2(SolverState<BOARD_SECTION_LEN> *state);
+bool isPropagationKernelSupported(const PropagationKernel kernel);
+PropagationKernel getBestPropagationKernel();
+bool parsePropagationKernel(const char *text, PropagationKernel *kernel);
+template <int SECTION_LEN>
+void placeSolverDigit(SolverState<SECTION_LEN> *state, const int cell, const int digit);
+template <int SECTION_LEN>
+void removeSolverDigit(SolverState<SECTION_LEN> *state, const int cell);
+template <int SECTION_LEN>
+typename BoardSize<SECTION_LEN>::Mask getSolverCandidates(const SolverState<SECTION_LEN> *state,
+                                                          const int cell);
+template <int SECTION_LEN = BOARD_SECTION_LEN>
+int getUnitCell(const int unit, const int index);
+
+DlxArena *getThreadDlxArena();
+void initDlxArena(DlxArena *arena);
+int solveWithDlx(DlxArena *arena, const Board *puzzle, const int limit, Board *solution);
+void searchDlx(DlxArena *arena, const int limit, int *solutionsCount, Board *solution);
+void coverDlxColumn(DlxArena *arena, const int col);
+void uncoverDlxColumn(DlxArena *arena, const int col);
+void selectDlxRow(DlxArena *arena, const int node);
+void unselectDlxRow(DlxArena *arena, const int node);
+int getDlxRowNode(const int cell, const int digit);
+
+Grade gradePuzzle(const Board *puzzle);
+bool initGradingState(GradingState *state, const Board *puzzle);
+bool applyTechnique(GradingState *state, const Technique technique);
+bool applyHiddenSingles(GradingState *state);
+bool applyNakedSingles(GradingState *state);
+bool applyLockedCandidates(GradingState *state);
+bool applyNakedSubsets(GradingState *state, const int size);
+bool applyHiddenSubsets(GradingState *state, const int size);
+bool applyFish(GradingState *state, const int size);
+void placeGradingDigit(GradingState *state, const int cell, const int digit);
+bool eliminateCandidates(GradingState *state, const int cell, const uint16_t digitsMask);
+uint16_t getDigitPositions(const GradingState *state, const int unit, const uint16_t digitBit);
+template <int SECTION_LEN>
+void findHint(const BasicBoard<SECTION_LEN> *digits, const BasicBoard<SECTION_LEN> *solution, Hint *hint);
+bool findLogicalStep(const Board *digits, Hint *hint);
+template <int SECTION_LEN>
+bool findSingle(const typename BoardSize<SECTION_LEN>::Mask *candidates, Hint *hint);
+template <int SECTION_LEN>
+bool isMistakenCell(const BasicBoard<SECTION_LEN> *digits, const BasicBoard<SECTION_LEN> *solution,
+                    const int cell);
+const char *getHintStepName(const int technique);
+
+template <int SECTION_LEN>
+void copyDigits(BasicBoard<SECTION_LEN> *from, BasicBoard<SECTION_LEN> *to);
+
+template <int SECTION_LEN>
+void refreshField(BasicBoard<SECTION_LEN> *currentDigits, BasicBoard<SECTION_LEN> *defaultDigits,
+                  Progress<SECTION_LEN> *progress, const int dimension, int *playerPosY, int *playerPosX,
+                  int *initialDigitsShownCount);
+template <int SECTION_LEN>
+void refreshCurrentData(BasicBoard<SECTION_LEN> *defaultDigits, const int dimension, int *playerPosY,
+                        int *playerPosX, int *initialDigitsShownCount);
+template <int SECTION_LEN>
+void recreateDigits(BasicBoard<SECTION_LEN> *currentDigits, BasicBoard<SECTION_LEN> *defaultDigits,
+                    BasicBoard<SECTION_LEN> *solvedMtrx, Progress<SECTION_LEN> *progress, const PuzzleDb *db,
+                    PuzzlePool<SECTION_LEN> *pool, Random *random, const int dimension, int *playerPosY,
+                    int *playerPosX, int *initialDigitsShownCount);
+
+template <int SECTION_LEN>
+void startGameSession(GameSession<SECTION_LEN> *session, const uint64_t seed, const uint64_t stream,
+                      const PuzzleDb *db);
+template <int SECTION_LEN>
+void doSessionAction(GameSession<SECTION_LEN> *session, const SessionAction action, const int digit,
+                     const PuzzleDb *db, PuzzlePool<SECTION_LEN> *pool);
+template <int SECTION_LEN>
+void takeSessionHint(GameSession<SECTION_LEN> *session, Hint *hint);
+
+template <int SECTION_LEN>
+void clearSell(BasicBoard<SECTION_LEN> *currentDigits, BasicBoard<SECTION_LEN> *defaultDigits,
+               Progress<SECTION_LEN> *progress, const int row, const int col);
+template <int SECTION_LEN>
+void changeSell(BasicBoard<SECTION_LEN> *currentDigits, BasicBoard<SECTION_LEN> *defaultDigits,
+                Progress<SECTION_LEN> *progress, const int row, const int col, const int digit);
+
+void clearScreen(Screen *screen);
+template <typename T>
+void putText(Screen *screen, const int fgColor, const int bgColor, const T text);
+void putGlyph(Screen *screen, const int fgColor, const int bgColor, const char glyph);
+void presentScreen(Screen *screen);
+void composeScreenUpdate(Screen *screen, const int terminalRowsCount);
+bool isBlankScreenCell(const ScreenCell cell);
+bool isSameScreenCell(const ScreenCell first, const ScreenCell second);
+void appendCursorMove(std::vector<char> *output, const int row, const int col, const int cursorRow,
+                      const bool isScrolling);
+void appendColors(std::vector<char> *output, const int fgColor, const int bgColor);
+int getTerminalRowsCount();
+void writeWholeBuffer(int fd, const char *data, const size_t size);
+
+void showRules(Screen *screen, const int dimension, const int sectionLen);
+void showMenu(Screen *screen, const int countOfCorrectDigitsShown, const int dimension,
+              const uint64_t pooledFieldsCount, const uint64_t generatedFieldsCount);
+void showEndOfGame(Screen *screen, const int filledSellsCount);
+
+void enableStats(const int mode);
+bool finishStats(const char *tracePath);
+StatsShard *getThreadStatsShard();
+void recordStatSample(const StatHistogram histogram, const uint64_t startNs, const uint64_t value);
+int getStatBucket(const uint64_t value);
+uint64_t getStatBucketLimit(const int bucket);
+uint64_t getHistogramPercentile(const Histogram *histogram, const int percent);
+void addHistogram(const Histogram *from, Histogram *to);
+void appendStatsReport(std::vector<char> *output);
+void appendHistogramBars(const char *name, const Histogram *histogram, std::vector<char> *output);
+bool writeTrace(const char *path);
+uint64_t getStatsClock();
+void countStat(const StatCounter counter, const uint64_t amount);
+uint64_t startStatTimer();
+void stopStatTimer(const StatHistogram histogram, const uint64_t startNs);
+void recordStatValue(const StatHistogram histogram, const uint64_t value);
+
+template <int SECTION_LEN>
+int getDigit(const BasicBoard<SECTION_LEN> *board, const int row, const int col);
+template <int SECTION_LEN>
+void setDigit(BasicBoard<SECTION_LEN> *board, const int cell, const int digit);
+template <int SECTION_LEN>
+void updateUnitsOfCell(BasicBoard<SECTION_LEN> *board, const int cell, const int digit, const int delta);
+
+template <int SECTION_LEN = BOARD_SECTION_LEN>
+int getSectionIndex(const int row, const int col);
+uint32_t getDigitBit(const int digit);
+template <int SECTION_LEN>
+typename BoardSize<SECTION_LEN>::Mask getCandidatesMask(const BasicBoard<SECTION_LEN> *board, const int cell);
+template <int SECTION_LEN>
+int getCandidatesCount(const BasicBoard<SECTION_LEN> *board, const int cell);
+int getNthDigitOfMask(uint32_t mask, int n);
+char getDigitChar(const int digit);
+int getCharDigit(const char digitChar);
+
+template <int SECTION_LEN>
+Color getFgColor(BasicBoard<SECTION_LEN> *digits, BasicBoard<SECTION_LEN> *defaultDigits,
+                 const Progress<SECTION_LEN> *progress, const int row, const int col, const int playerPosX,
+                 const int playerPosY);
+
+template <int SECTION_LEN>
+int getCountOfShownDigits(BasicBoard<SECTION_LEN> *defaultDigits, const int dimension);
+
+template <int SECTION_LEN>
+bool isDefaultDigit(BasicBoard<SECTION_LEN> *currentDigits, BasicBoard<SECTION_LEN> *defaultDigits,
+                    const int row, const int col);
+template <int SECTION_LEN>
+bool isEnteredDigitCorrect(BasicBoard<SECTION_LEN> *digits, const int row, const int col);
+
+// Kernel of the 9x9 bitmask solver: the fastest one the CPU supports, unless an option picks
+// another before any solving thread starts.
+extern PropagationKernel boardPropagationKernel;
+
+// STATS_REPORTED and STATS_TRACED as the options set them, before any thread is started.
+extern int statsMode;
+
+template <int SECTION_LEN>
+void setCountOfCorrectDigitsShown(int &countOfCorrectDigitsShown, const Progress<SECTION_LEN> *progress) {
+      countOfCorrectDigitsShown = progress->correctDigitsCount;
+}
+
+template <int SECTION_LEN>
+void resetProgress(Progress<SECTION_LEN> *progress, BasicBoard<SECTION_LEN> *digits,
+                   BasicBoard<SECTION_LEN> *defaultDigits) {
+      using Size = BoardSize<SECTION_LEN>;
+
+      const int HIDDEN_DIGIT = 0;
+
+      progress->correctDigitsCount = 0;
+
+      for (int cell = 0; cell < Size::CELLS_COUNT; cell++) {
+            const int digit = digits->digits[cell];
+
+            progress->conflictsCounts[cell] = 0;
+
+            if (digit == HIDDEN_DIGIT) continue;
+
+            for (int peer : CELL_LAYOUT<SECTION_LEN>.peerCells[cell])
+                  if (digits->digits[peer] == digit) progress->conflictsCounts[cell]++;
+
+            if (isCellCorrect(progress, defaultDigits, cell)) progress->correctDigitsCount++;
+      }
+}
+
+// Puts the digit (0 hides the cell) and moves the conflicts of the old and the new digit
+// between the cell and its peers.
+template <int SECTION_LEN>
+void updateProgress(Progress<SECTION_LEN> *progress, BasicBoard<SECTION_LEN> *digits,
+                    BasicBoard<SECTION_LEN> *defaultDigits, const int row, const int col, const int digit) {
+      using Size = BoardSize<SECTION_LEN>;
+
+      const int HIDDEN_DIGIT = 0;
+      const int cell = row * Size::DIMENSION + col;
+      const int previousDigit = digits->digits[cell];
+
+      if (previousDigit == digit) return;
+
+      countStat(StatCounter::ProgressUpdates, 1);
+
+      if (previousDigit != HIDDEN_DIGIT) {
+            if (isCellCorrect(progress, defaultDigits, cell)) progress->correctDigitsCount--;
+
+            for (int peer : CELL_LAYOUT<SECTION_LEN>.peerCells[cell]) {
+                  if (digits->digits[peer] == previousDigit)
+                        changeConflictsCount(progress, defaultDigits, peer, -1);
+            }
+
+            progress->conflictsCounts[cell] = 0;
+      }
+
+      setDigit(digits, cell, digit);
+
+      if (digit != HIDDEN_DIGIT) {
+            for (int peer : CELL_LAYOUT<SECTION_LEN>.peerCells[cell]) {
+                  if (digits->digits[peer] == digit) {
+                        changeConflictsCount(progress, defaultDigits, peer, +1);
+                        progress->conflictsCounts[cell]++;
+                  }
+            }
+
+            if (isCellCorrect(progress, defaultDigits, cell)) progress->correctDigitsCount++;
+      }
+}
+
+template <int SECTION_LEN>
+void changeConflictsCount(Progress<SECTION_LEN> *progress, BasicBoard<SECTION_LEN> *defaultDigits,
+                          const int cell, const int delta) {
+      const bool wasCorrect = isCellCorrect(progress, defaultDigits, cell);
+
+      progress->conflictsCounts[cell] += delta;
+
+      progress->correctDigitsCount += isCellCorrect(progress, defaultDigits, cell) - wasCorrect;
+}
+
+template <int SECTION_LEN>
+bool isCellCorrect(const Progress<SECTION_LEN> *progress, BasicBoard<SECTION_LEN> *defaultDigits,
+                   const int cell) {
+      return defaultDigits->digits[cell] != 0 || progress->conflictsCounts[cell] == 0;
+}
+
+// Takes the field from the database, if there is one, else from the pool, if there is one with a
+// puzzle ready, or generates it.
+template <int SECTION_LEN>
+void initDigits(BasicBoard<SECTION_LEN> *defaultDigitsPtr, BasicBoard<SECTION_LEN> *solvedDigitsPtr,
+                BasicBoard<SECTION_LEN> *currentDigitsPtr, const PuzzleDb *db, PuzzlePool<SECTION_LEN> *pool,
+                Random *random) {
+      const int *BAND = DIFFICULTY_RATING_BANDS[Difficulty::Medium];
+
+      bool isTaken = false;
+
+      if constexpr (SECTION_LEN == BOARD_SECTION_LEN)
+            isTaken = db != nullptr &&
+                      takeDbPuzzle(db, BAND[0], BAND[1], random, defaultDigitsPtr, solvedDigitsPtr);
+
+      if (!isTaken && (pool == nullptr || !takePooledPuzzle(pool, Difficulty::Medium, defaultDigitsPtr,
+                                                            solvedDigitsPtr)))
+            generatePuzzle(defaultDigitsPtr, solvedDigitsPtr, Difficulty::Medium, random);
+
+      copyDigits(defaultDigitsPtr, currentDigitsPtr);
+}
+
+template <int SECTION_LEN>
+void generatePuzzle(BasicBoard<SECTION_LEN> *puzzle, BasicBoard<SECTION_LEN> *solution,
+                    const Difficulty difficulty, Random *random) {
+      uint64_t startNs = startStatTimer();
+      fillMtrxOfRandomDigitsFully(solution, BoardSize<SECTION_LEN>::DIMENSION, random);
+      stopStatTimer(StatHistogram::FillTime, startNs);
+
+      copyDigits(solution, puzzle);
+
+      startNs = startStatTimer();
+      hideAnyRandomDigits(puzzle, difficulty, random);
+      stopStatTimer(StatHistogram::HideTime, startNs);
+}
+
+template <int SECTION_LEN>
+void generateMinimalPuzzle(BasicBoard<SECTION_LEN> *puzzle, BasicBoard<SECTION_LEN> *solution,
+                           const int targetCluesCount, const bool isSymmetric, Random *random) {
+      uint64_t startNs = startStatTimer();
+      fillMtrxOfRandomDigitsFully(solution, BoardSize<SECTION_LEN>::DIMENSION, random);
+      stopStatTimer(StatHistogram::FillTime, startNs);
+
+      copyDigits(solution, puzzle);
+
+      startNs = startStatTimer();
+      removeCluesToMinimum(puzzle, solution, targetCluesCount, isSymmetric, random);
+      stopStatTimer(StatHistogram::MinimizeTime, startNs);
+}
+
+template <int SECTION_LEN>
+void startPuzzlePool(PuzzlePool<SECTION_LEN> *pool, const uint64_t seed, const uint32_t difficultiesMask) {
+      const uint64_t POOL_STREAM = 1;
+
+      for (PuzzleRing<SECTION_LEN> &ring : pool->rings) {
+            ring.tail.store(0, std::memory_order_relaxed);
+            ring.head.store(0, std::memory_order_relaxed);
+      }
+
+      pool->difficultiesMask = difficultiesMask;
+      pool->hitsCount = pool->missesCount = 0;
+      pool->isStopping.store(false, std::memory_order_relaxed);
+
+      seedRandom(&pool->random, seed, POOL_STREAM);
+
+      // A pool without difficulties has nothing to produce, so it gets no thread.
+      if (difficultiesMask != 0) pool->producer = std::thread(producePooledPuzzles<SECTION_LEN>, pool);
+}
+
+// Waits for the producer to finish the puzzle it is generating.
+template <int SECTION_LEN>
+void stopPuzzlePool(PuzzlePool<SECTION_LEN> *pool) {
+      if (!pool->producer.joinable()) return;
+
+      {
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            pool->isStopping.store(true, std::memory_order_relaxed);
+      }
+
+      pool->wakeUp.notify_one();
+      pool->producer.join();
+}
+
+// Generates every puzzle right into the free slot of its ring.
+template <int SECTION_LEN>
+void producePooledPuzzles(PuzzlePool<SECTION_LEN> *pool) {
+      const int NO_RING = -1;
+
+      for (;;) {
+            int difficulty = findRingToFill(pool);
+
+            if (difficulty == NO_RING) {
+                  std::unique_lock<std::mutex> lock(pool->mutex);
+
+                  while (!pool->isStopping.load(std::memory_order_relaxed) &&
+                         (difficulty = findRingToFill(pool)) == NO_RING)
+                        pool->wakeUp.wait(lock);
+            }
+
+            if (pool->isStopping.load(std::memory_order_relaxed)) return;
+
+            PuzzleRing<SECTION_LEN> *ring = &pool->rings[difficulty];
+            const uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+            PooledPuzzle<SECTION_LEN> *pooled = &ring->puzzles[tail & (PUZZLE_RING_CAPACITY - 1)];
+
+            generatePuzzle(&pooled->puzzle, &pooled->solution, (Difficulty)difficulty, &pool->random);
+
+            ring->tail.store(tail + 1, std::memory_order_release);
+      }
+}
+
+// The pooled difficulty whose ring has the fewest puzzles, or -1 when all of them are full.
+template <int SECTION_LEN>
+int findRingToFill(PuzzlePool<SECTION_LEN> *pool) {
+      int ringToFill = -1;
+      uint32_t fewestCount = PUZZLE_RING_CAPACITY;
+
+      for (int difficulty = 0; difficulty < DIFFICULTIES_COUNT; difficulty++) {
+            if ((pool->difficultiesMask & (1 << difficulty)) == 0) continue;
+
+            const PuzzleRing<SECTION_LEN> *ring = &pool->rings[difficulty];
+            const uint32_t count =
+                ring->tail.load(std::memory_order_relaxed) - ring->head.load(std::memory_order_acquire);
+
+            if (count < fewestCount) {
+                  ringToFill = difficulty;
+                  fewestCount = count;
+            }
+      }
+
+      return ringToFill;
+}
+
+// Returns false when no puzzle of the difficulty is ready.
+template <int SECTION_LEN>
+bool takePooledPuzzle(PuzzlePool<SECTION_LEN> *pool, const Difficulty difficulty,
+                      BasicBoard<SECTION_LEN> *puzzle, BasicBoard<SECTION_LEN> *solution) {
+      PuzzleRing<SECTION_LEN> *ring = &pool->rings[difficulty];
+      const uint32_t head = ring->head.load(std::memory_order_relaxed);
+
+      if (head == ring->tail.load(std::memory_order_acquire)) {
+            pool->missesCount++;
+
+            return false;
+      }
+
+      const PooledPuzzle<SECTION_LEN> *pooled = &ring->puzzles[head & (PUZZLE_RING_CAPACITY - 1)];
+
+      *puzzle = pooled->puzzle;
+      *solution = pooled->solution;
+
+      ring->head.store(head + 1, std::memory_order_release);
+      pool->hitsCount++;
+
+      // Taking the lock orders the pop before the producer's check, so the wake-up can't be lost.
+      { std::lock_guard<std::mutex> lock(pool->mutex); }
+      pool->wakeUp.notify_one();
+
+      return true;
+}
+
+template <int SECTION_LEN>
+void drawField(Screen *screen, BasicBoard<SECTION_LEN> *digits, BasicBoard<SECTION_LEN> *defaultDigits,
+               const Progress<SECTION_LEN> *progress, const int dimension, const int playerPosX,
+               const int playerPosY) {
+      const int SIDE_BORDERS_COUNT = SECTION_LEN + 1;
+      const int BORDER_PERIOD = SECTION_LEN + 1;
+      const char VERTICAL_LINE = '|', HORIZONTAL_LINE = '-';
+      const char SPACE_BAR = ' ';
+      const char HIDDEN_CELL = '*';
+
+      Color fgColor = Color::Default, bgColor = Color::Default;
+
+      for (int i = 0, row = 0; i < dimension + SIDE_BORDERS_COUNT; i++) {
+            for (int j = 0, col = 0; j < dimension + SIDE_BORDERS_COUNT; j++) {
+                  putGlyph(screen, Color::Default, Color::Default, SPACE_BAR);
+
+                  fgColor = getFgColor(digits, defaultDigits, progress, row, col, playerPosX, playerPosY);
+
+                  if (i % BORDER_PERIOD == 0)
+                        putGlyph(screen, Color::Default, Color::Default, HORIZONTAL_LINE);
+                  else if (j % BORDER_PERIOD == 0)
+                        putGlyph(screen, Color::Default, Color::Default, VERTICAL_LINE);
+                  else if (getDigit(digits, row, col) == 0)
+                        putGlyph(screen, fgColor, bgColor, HIDDEN_CELL);
+                  else
+                        putGlyph(screen, fgColor, bgColor, getDigitChar(getDigit(digits, row, col)));
+
+                  col = j % BORDER_PERIOD != 0 ? col + 1 : col;
+            }
+
+            row = i % BORDER_PERIOD != 0 && row + 1 != dimension ? row + 1 : row;
+
+            putGlyph(screen, Color::Default, Color::Default, '\n');
+      }
+}
+
+// Builds a random solved field by depth-first search over the cells in row-major order, trying
+// the candidates of every cell in random order. Unlike clearing whole lines on a dead end, the
+// search steps back one cell at a time, so its cost stays within tens of microseconds. Returns
+// how many times it had to step back.
+template <int SECTION_LEN>
+int fillMtrxOfRandomDigitsFully(BasicBoard<SECTION_LEN> *mtrxPtr, const int dimension, Random *random) {
+      using Size = BoardSize<SECTION_LEN>;
+
+      if constexpr (SECTION_LEN > BOARD_SECTION_LEN) return fillMtrxByMostConstrainedCells(mtrxPtr, random);
+
+      const int cellsCount = dimension * dimension;
+
+      typename Size::Mask untriedDigits[Size::CELLS_COUNT];
+      int backtracksCount = 0;
+
+      *mtrxPtr = BasicBoard<SECTION_LEN>{};
+      untriedDigits[0] = Size::ALL_DIGITS_MASK;
+
+      for (int cell = 0; cell < cellsCount;) {
+            if (untriedDigits[cell] == 0) {
+                  backtracksCount++;
+
+                  cell--;
+                  setDigit(mtrxPtr, cell, 0);
+
+                  continue;
+            }
+
+            const int untriedCount = __builtin_popcount(untriedDigits[cell]);
+            int randomDigit = getNthDigitOfMask(untriedDigits[cell], getRandomInt(random, untriedCount));
+
+            untriedDigits[cell] &= ~getDigitBit(randomDigit);
+            setDigit(mtrxPtr, cell, randomDigit);
+
+            if (++cell < cellsCount) untriedDigits[cell] = getCandidatesMask(mtrxPtr, cell);
+      }
+
+      countStat(StatCounter::FillBacktracks, backtracksCount);
+
+      return backtracksCount;
+}
+
+// Fills the fields above 9x9, where the row-major search gets lost in dead ends. Every step takes
+// the hidden cell with the fewest candidates, so a cell left without any is found at once, and a
+// search which has stepped back too often starts over with new random choices, which cuts off
+// the long tail of unlucky runs. Returns how many times it had to step back.
+template <int SECTION_LEN>
+int fillMtrxByMostConstrainedCells(BasicBoard<SECTION_LEN> *mtrxPtr, Random *random) {
+      using Size = BoardSize<SECTION_LEN>;
+
+      const int HIDDEN_DIGIT = 0;
+      const int RESTART_BACKTRACKS_COUNT = Size::CELLS_COUNT;
+
+      int filledCells[Size::CELLS_COUNT];
+      typename Size::Mask untriedDigits[Size::CELLS_COUNT];
+      int backtracksCount = 0, backtracksSinceRestart = 0, restartsCount = 0;
+      bool isSteppedBack = false;
+
+      *mtrxPtr = BasicBoard<SECTION_LEN>{};
+
+      for (int depth = 0; depth < Size::CELLS_COUNT;) {
+            if (!isSteppedBack) {
+                  int bestCell = -1, bestCount = Size::DIMENSION + 1;
+
+                  for (int cell = 0; bestCount > 1 && cell < Size::CELLS_COUNT; cell++) {
+                        if (mtrxPtr->digits[cell] != HIDDEN_DIGIT) continue;
+
+                        const int count = getCandidatesCount(mtrxPtr, cell);
+
+                        if (count < bestCount) {
+                              bestCell = cell;
+                              bestCount = count;
+                        }
+                  }
+
+                  filledCells[depth] = bestCell;
+                  untriedDigits[depth] = getCandidatesMask(mtrxPtr, bestCell);
+            }
+
+            isSteppedBack = false;
+
+            if (untriedDigits[depth] == 0) {
+                  backtracksCount++;
+
+                  if (++backtracksSinceRestart > RESTART_BACKTRACKS_COUNT) {
+                        *mtrxPtr = BasicBoard<SECTION_LEN>{};
+                        depth = backtracksSinceRestart = 0;
+                        restartsCount++;
+
+                        continue;
+                  }
+
+                  depth--;
+                  setDigit(mtrxPtr, filledCells[depth], HIDDEN_DIGIT);
+                  isSteppedBack = true;
+
+                  continue;
+            }
+
+            const int untriedCount = __builtin_popcount(untriedDigits[depth]);
+            const int randomDigit = getNthDigitOfMask(untriedDigits[depth],
+                                                      getRandomInt(random, untriedCount));
+
+            untriedDigits[depth] &= ~getDigitBit(randomDigit);
+            setDigit(mtrxPtr, filledCells[depth], randomDigit);
+            depth++;
+      }
+
+      countStat(StatCounter::FillBacktracks, backtracksCount);
+      countStat(StatCounter::FillRestarts, restartsCount);
+
+      return backtracksCount;
+}
+
+// The difficulty sets how many digits every section tries to hide, out of 9 and in proportion on
+// the other sizes; the ones whose removal breaks uniqueness stay shown. The board is expected to
+// hold a solved field.
+template <int SECTION_LEN>
+void hideAnyRandomDigits(BasicBoard<SECTION_LEN> *digitsPtr, const Difficulty difficulty, Random *random) {
+      const int LEFT_GROUNDS[] = {4, 5, 7}, RIGHT_GROUNDS[] = {5, 7, 9};
+      const int SECTIONS_COUNT = BoardSize<SECTION_LEN>::DIMENSION;
+      const int LEFT_GROUND = LEFT_GROUNDS[difficulty] * SECTIONS_COUNT / BOARD_DIMENSION;
+      const int RIGHT_GROUND = RIGHT_GROUNDS[difficulty] * SECTIONS_COUNT / BOARD_DIMENSION;
+
+      const BasicBoard<SECTION_LEN> solution = *digitsPtr;
+
+      SolverState<SECTION_LEN> cluesState;
+      initSolverState(&cluesState, digitsPtr);
+
+      for (int i = 0; i < SECTIONS_COUNT; i++) {
+            int amountOfHiddenDigits = LEFT_GROUND + getRandomInt(random, RIGHT_GROUND - LEFT_GROUND + 1);
+
+            int startIndexOfSectionRow = SECTION_LEN * (i / SECTION_LEN);
+            int startIndexOfSectionCol = SECTION_LEN * (i - SECTION_LEN * (i / SECTION_LEN));
+
+            hideDigitsInThisSection(digitsPtr, &solution, &cluesState, amountOfHiddenDigits,
+                                    startIndexOfSectionRow, startIndexOfSectionCol, random);
+      }
+}
+
+// Hides up to amountOfHiddenDigits digits of the section, skipping the ones whose removal would
+// give the puzzle a second solution. cluesState follows the shown digits of the board.
+template <int SECTION_LEN>
+void hideDigitsInThisSection(BasicBoard<SECTION_LEN> *digitPtr, const BasicBoard<SECTION_LEN> *solution,
+                             SolverState<SECTION_LEN> *cluesState, int amountOfHiddenDigits,
+                             const int startRow, const int startCol, Random *random) {
+      const int DIMENSION = BoardSize<SECTION_LEN>::DIMENSION;
+      const int section = getSectionIndex<SECTION_LEN>(startRow, startCol);
+
+      typename BoardSize<SECTION_LEN>::Mask removableDigits = digitPtr->usedMasks[SECTION_UNIT][section];
+      int checksCount = 0, hiddenCount = amountOfHiddenDigits;
+
+      while (amountOfHiddenDigits != 0 && removableDigits != 0) {
+            const int removableCount = __builtin_popcount(removableDigits);
+            int randomDigit = getNthDigitOfMask(removableDigits, getRandomInt(random, removableCount));
+
+            removableDigits &= ~getDigitBit(randomDigit);
+
+            for (const int cell : CELL_LAYOUT<SECTION_LEN>.unitCells[SECTION_UNIT * DIMENSION + section]) {
+                  if (digitPtr->digits[cell] != randomDigit) continue;
+
+                  checksCount++;
+
+                  if (isRemovalUnique(cluesState, solution, &cell, 1)) {
+                        setDigit(digitPtr, cell, 0);
+                        removeSolverDigit(cluesState, cell);
+
+                        amountOfHiddenDigits--;
+                  }
+
+                  break;
+            }
+      }
+
+      countStat(StatCounter::HideChecks, checksCount);
+      countStat(StatCounter::HiddenDigits, hiddenCount - amountOfHiddenDigits);
+}
+
+// Hides clues one at a time, or in pairs symmetric about the centre, in random order and keeps a
+// removal only while the solution stays unique. Stops once targetCluesCount clues are left, with 0
+// when no clue can go any more; one pass is enough for that, since a clue which can't go now can't
+// go after more are hidden either. The puzzle is expected to hold the solution's digits only.
+// Removals are checked against a solver state of the current clues which is updated in place.
+// Returns the number of clues left.
+template <int SECTION_LEN>
+int removeCluesToMinimum(BasicBoard<SECTION_LEN> *puzzle, const BasicBoard<SECTION_LEN> *solution,
+                         const int targetCluesCount, const bool isSymmetric, Random *random) {
+      using Size = BoardSize<SECTION_LEN>;
+
+      const int HIDDEN_DIGIT = 0;
+
+      int cells[Size::CELLS_COUNT];
+      int cellsCount = 0;
+
+      for (int cell = 0; cell < Size::CELLS_COUNT; cell++) {
+            const int mirrorCell = Size::CELLS_COUNT - 1 - cell;
+
+            if (puzzle->digits[cell] != HIDDEN_DIGIT && (!isSymmetric || mirrorCell >= cell))
+                  cells[cellsCount++] = cell;
+      }
+
+      for (int i = cellsCount - 1; i > 0; i--) std::swap(cells[i], cells[getRandomInt(random, i + 1)]);
+
+      SolverState<SECTION_LEN> cluesState;
+      initSolverState(&cluesState, puzzle);
+
+      int cluesCount = Size::CELLS_COUNT - cluesState.hiddenCount;
+      int checksCount = 0;
+
+      for (int i = 0; i < cellsCount && cluesCount > targetCluesCount; i++) {
+            const int group[] = {cells[i], Size::CELLS_COUNT - 1 - cells[i]};
+            const int groupSize = isSymmetric && group[1] != group[0] ? 2 : 1;
+
+            if (cluesCount - groupSize < targetCluesCount) continue;
+
+            checksCount++;
+
+            if (!isRemovalUnique(&cluesState, solution, group, groupSize)) continue;
+
+            for (int j = 0; j < groupSize; j++) {
+                  removeSolverDigit(&cluesState, group[j]);
+                  setDigit(puzzle, group[j], HIDDEN_DIGIT);
+            }
+
+            cluesCount -= groupSize;
+      }
+
+      countStat(StatCounter::MinimizeChecks, checksCount);
+
+      return cluesCount;
+}
+
+// Whether the clues still allow a single solution once the cells are hidden as well. Instead of
+// counting the solutions of the smaller puzzle it looks for one which differs from the known
+// solution in a hidden cell, trying the other candidates of every cell in turn. Such searches
+// start with one more digit placed than a count from scratch and mostly die in propagation.
+//
+// On the larger fields a few of them run for long, so there the search has a budget and a removal
+// it can't decide on within it counts as breaking uniqueness: the clue stays, which is always
+// safe, but the puzzle may be left a little short of minimal. 9x9 checks are always exact.
+template <int SECTION_LEN>
+bool isRemovalUnique(const SolverState<SECTION_LEN> *cluesState, const BasicBoard<SECTION_LEN> *solution,
+                     const int *cells, const int cellsCount) {
+      const int NODES_BUDGET = SECTION_LEN <= BOARD_SECTION_LEN ? INT_MAX : 1 << 6;
+
+      SolverState<SECTION_LEN> state = *cluesState;
+      int nodesLeft = NODES_BUDGET;
+
+      for (int i = 0; i < cellsCount; i++) removeSolverDigit(&state, cells[i]);
+
+      for (int i = 0; i < cellsCount; i++) {
+            const int solvedDigit = solution->digits[cells[i]];
+
+            for (uint32_t otherDigits = getSolverCandidates(&state, cells[i]) & ~getDigitBit(solvedDigit);
+                 otherDigits != 0; otherDigits &= otherDigits - 1) {
+                  SolverState<SECTION_LEN> otherState = state;
+                  int solutionsCount = 0;
+
+                  placeSolverDigit(&otherState, cells[i], __builtin_ctz(otherDigits) + 1);
+                  searchSolutions<SECTION_LEN>(otherState, 1, &solutionsCount, nullptr, solution->digits,
+                                               &nodesLeft);
+
+                  if (solutionsCount != 0 || nodesLeft < 0) return false;
+            }
+
+            // Solutions differing in a later cell only have to agree with the known one here.
+            placeSolverDigit(&state, cells[i], solvedDigit);
+      }
+
+      return true;
+}
+
+inline uint64_t getNextRandom(Random *random) {
+      uint64_t *s = random->state;
+
+      const uint64_t result = rotateLeft(s[1] * 5, 7) * 9;
+      const uint64_t t = s[1] << 17;
+
+      s[2] ^= s[0];
+      s[3] ^= s[1];
+      s[1] ^= s[2];
+      s[0] ^= s[3];
+      s[2] ^= t;
+      s[3] = rotateLeft(s[3], 45);
+
+      return result;
+}
+
+// Random number in [0, bound) by multiply-shift, without the modulo of rand() % bound.
+inline int getRandomInt(Random *random, const int bound) {
+      return (int)(((getNextRandom(random) >> 32) * (uint64_t)bound) >> 32);
+}
+
+// The same for bounds beyond 32 bits, such as the records of a database.
+inline uint64_t getRandomIndex(Random *random, const uint64_t bound) {
+      return (uint64_t)(((unsigned __int128)getNextRandom(random) * bound) >> 64);
+}
+
+inline uint64_t getSplitMix64(uint64_t *state) {
+      uint64_t z = (*state += 0x9e3779b97f4a7c15);
+
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+
+      return z ^ (z >> 31);
+}
+
+inline uint64_t rotateLeft(const uint64_t value, const int shift) {
+      return value << shift | value >> (64 - shift);
+}
+
+template <int SECTION_LEN>
+bool solve(const BasicBoard<SECTION_LEN> *puzzle, BasicBoard<SECTION_LEN> *solution,
+           const SolverBackend backend) {
+      return findSolutions(puzzle, 1, solution, backend) == 1;
+}
+
+// Number of solutions of the puzzle, the search stops as soon as limit of them are found.
+template <int SECTION_LEN>
+int countSolutions(const BasicBoard<SECTION_LEN> *puzzle, const int limit, const SolverBackend backend) {
+      return findSolutions<SECTION_LEN>(puzzle, limit, nullptr, backend);
+}
+
+// Counts the solutions up to the limit like countSolutions and also stores the first one found
+// unless firstSolution is null. Dancing Links is built for the 9x9 field, other sizes always use
+// the bitmask search.
+template <int SECTION_LEN>
+int findSolutions(const BasicBoard<SECTION_LEN> *puzzle, const int limit,
+                  BasicBoard<SECTION_LEN> *firstSolution,
+                  const SolverBackend backend) {
+      using Size = BoardSize<SECTION_LEN>;
+
+      if constexpr (SECTION_LEN == BOARD_SECTION_LEN) {
+            if (backend == SolverBackend::DancingLinks)
+                  return solveWithDlx(getThreadDlxArena(), puzzle, limit, firstSolution);
+      }
+
+      SolverState<SECTION_LEN> state, solvedState;
+      int solutionsCount = 0;
+
+      if (initSolverState(&state, puzzle)) searchSolutions(state, limit, &solutionsCount, &solvedState);
+
+      if (solutionsCount != 0 && firstSolution != nullptr) {
+            *firstSolution = BasicBoard<SECTION_LEN>{};
+
+            for (int cell = 0; cell < Size::CELLS_COUNT; cell++) {
+                  setDigit(firstSolution, cell, solvedState.digits[cell]);
+            }
+      }
+
+      return solutionsCount;
+}
+
+// Returns false if the shown digits of the puzzle already conflict.
+template <int SECTION_LEN>
+bool initSolverState(SolverState<SECTION_LEN> *state, const BasicBoard<SECTION_LEN> *puzzle) {
+      using Size = BoardSize<SECTION_LEN>;
+
+      const int HIDDEN_DIGIT = 0;
+
+      *state = SolverState<SECTION_LEN>{};
+      state->hiddenCount = Size::CELLS_COUNT;
+
+      for (int unit = 0; unit < Size::DIMENSION; unit++) {
+            for (int kind = 0; kind < UNIT_KINDS_COUNT; kind++)
+                  if (puzzle->conflictMasks[kind][unit] != 0) return false;
+      }
+
+      for (int cell = 0; cell < Size::CELLS_COUNT; cell++)
+            if (puzzle->digits[cell] != HIDDEN_DIGIT) placeSolverDigit(state, cell, puzzle->digits[cell]);
+
+      return true;
+}
+
+// Depth-first search: fills forced cells, then guesses on the cell with the fewest candidates.
+// A guess tries the cell's digit of preferredDigits first when one is given. With nodesLeft the
+// search gives up once it has visited that many states, leaving the count below 0.
+template <int SECTION_LEN>
+void searchSolutions(SolverState<SECTION_LEN> state, const int limit, int *solutionsCount,
+                     SolverState<SECTION_LEN> *firstSolution, const uint8_t *preferredDigits,
+                     int *nodesLeft) {
+      using Size = BoardSize<SECTION_LEN>;
+
+      const int HIDDEN_DIGIT = 0;
+
+      if (nodesLeft != nullptr && --*nodesLeft < 0) return;
+
+      if constexpr (SECTION_LEN == BOARD_SECTION_LEN) {
+            if (!propagateBoardSingles(&state)) return;
+      } else if (!propagateSingles(&state)) {
+            return;
+      }
+
+      if (state.hiddenCount == 0) {
+            if (*solutionsCount == 0 && firstSolution != nullptr) *firstSolution = state;
+
+            (*solutionsCount)++;
+
+            return;
+      }
+
+      int guessCell = -1, guessCandidatesCount = Size::DIMENSION + 1;
+
+      for (int cell = 0; guessCandidatesCount > 2 && cell < Size::CELLS_COUNT; cell++) {
+            if (state.digits[cell] != HIDDEN_DIGIT) continue;
+
+            int candidatesCount = __builtin_popcount(getSolverCandidates(&state, cell));
+
+            if (candidatesCount < guessCandidatesCount) {
+                  guessCell = cell;
+                  guessCandidatesCount = candidatesCount;
+            }
+      }
+
+      const uint32_t preferredBit = preferredDigits == nullptr ? 0 : getDigitBit(preferredDigits[guessCell]);
+
+      uint32_t candidates = getSolverCandidates(&state, guessCell);
+
+      while (candidates != 0 && *solutionsCount < limit) {
+            const uint32_t bit = (candidates & preferredBit) != 0 ? preferredBit : candidates & -candidates;
+            SolverState<SECTION_LEN> nextState = state;
+
+            candidates &= ~bit;
+            placeSolverDigit(&nextState, guessCell, __builtin_ctz(bit) + 1);
+
+            searchSolutions(nextState, limit, solutionsCount, firstSolution, preferredDigits, nodesLeft);
+      }
+}
+
+// Places naked singles (cells with one candidate) and hidden singles (digits with one place in a
+// unit) until none are left. Returns false when the state turns out to be contradictory.
+template <int SECTION_LEN>
+bool propagateSingles(SolverState<SECTION_LEN> *state) {
+      using Size = BoardSize<SECTION_LEN>;
+
+      const int HIDDEN_DIGIT = 0;
+
+      bool isChanged = true;
+
+      while (isChanged) {
+            isChanged = false;
+
+            for (int cell = 0; cell < Size::CELLS_COUNT; cell++) {
+                  if (state->digits[cell] != HIDDEN_DIGIT) continue;
+
+                  uint32_t candidates = getSolverCandidates(state, cell);
+
+                  if (candidates == 0) return false;
+
+                  if ((candidates & (candidates - 1)) == 0) {
+                        placeSolverDigit(state, cell, __builtin_ctz(candidates) + 1);
+                        isChanged = true;
+                  }
+            }
+
+            if (isChanged) continue;
+
+            for (int unit = 0; unit < Size::UNITS_COUNT; unit++) {
+                  uint32_t onceMask = 0, twiceMask = 0;
+
+                  for (int cell : CELL_LAYOUT<SECTION_LEN>.unitCells[unit]) {
+                        if (state->digits[cell] != HIDDEN_DIGIT) continue;
+
+                        uint32_t candidates = getSolverCandidates(state, cell);
+
+                        twiceMask |= onceMask & candidates;
+                        onceMask |= candidates;
+                  }
+
+                  if ((onceMask | state->usedMasks[unit]) != Size::ALL_DIGITS_MASK) return false;
+
+                  for (uint32_t singles = onceMask & ~twiceMask; singles != 0; singles &= singles - 1) {
+                        const uint32_t bit = singles & -singles;
+
+                        int singleCell = -1;
+                        for (int cell : CELL_LAYOUT<SECTION_LEN>.unitCells[unit]) {
+                              if (state->digits[cell] == HIDDEN_DIGIT &&
+                                  (getSolverCandidates(state, cell) & bit) != 0) {
+                                    singleCell = cell;
+
+                                    break;
+                              }
+                        }
+
+                        if (singleCell == -1) return false;
+
+                        placeSolverDigit(state, singleCell, __builtin_ctz(bit) + 1);
+                        isChanged = true;
+                  }
+            }
+      }
+
+      return true;
+}
+
+template <int SECTION_LEN>
+void placeSolverDigit(SolverState<SECTION_LEN> *state, const int cell, const int digit) {
+      const int DIMENSION = BoardSize<SECTION_LEN>::DIMENSION;
+      const CellLayout<SECTION_LEN> &layout = CELL_LAYOUT<SECTION_LEN>;
+      const uint32_t bit = getDigitBit(digit);
+
+      state->digits[cell] = digit;
+      state->usedMasks[ROW_UNIT * DIMENSION + layout.cellRows[cell]] |= bit;
+      state->usedMasks[COL_UNIT * DIMENSION + layout.cellCols[cell]] |= bit;
+      state->usedMasks[SECTION_UNIT * DIMENSION + layout.cellSections[cell]] |= bit;
+      state->hiddenCount--;
+}
+
+// Undoes placeSolverDigit. Clearing the unit bits is safe since the state never holds a digit
+// twice in a unit.
+template <int SECTION_LEN>
+void removeSolverDigit(SolverState<SECTION_LEN> *state, const int cell) {
+      const int DIMENSION = BoardSize<SECTION_LEN>::DIMENSION;
+      const CellLayout<SECTION_LEN> &layout = CELL_LAYOUT<SECTION_LEN>;
+      const uint32_t bit = getDigitBit(state->digits[cell]);
+
+      state->digits[cell] = 0;
+      state->usedMasks[ROW_UNIT * DIMENSION + layout.cellRows[cell]] &= ~bit;
+      state->usedMasks[COL_UNIT * DIMENSION + layout.cellCols[cell]] &= ~bit;
+      state->usedMasks[SECTION_UNIT * DIMENSION + layout.cellSections[cell]] &= ~bit;
+      state->hiddenCount++;
+}
+
+template <int SECTION_LEN>
+typename BoardSize<SECTION_LEN>::Mask getSolverCandidates(const SolverState<SECTION_LEN> *state,
+                                                          const int cell) {
+      using Size = BoardSize<SECTION_LEN>;
+
+      const CellLayout<SECTION_LEN> &layout = CELL_LAYOUT<SECTION_LEN>;
+
+      return Size::ALL_DIGITS_MASK &
+             ~(state->usedMasks[ROW_UNIT * Size::DIMENSION + layout.cellRows[cell]] |
+               state->usedMasks[COL_UNIT * Size::DIMENSION + layout.cellCols[cell]] |
+               state->usedMasks[SECTION_UNIT * Size::DIMENSION + layout.cellSections[cell]]);
+}
+
+// Cell index of the index-th cell of the unit, numbered as in SolverState::usedMasks.
+template <int SECTION_LEN>
+int getUnitCell(const int unit, const int index) {
+      return CELL_LAYOUT<SECTION_LEN>.unitCells[unit][index];
+}
+
+// Finds the next step from the player's digits. The unit masks of the board are kept up to date by
+// setDigit on every edit, so the candidates of the hidden cells come straight from them and a hint
+// takes microseconds however long the game has gone on. Without a logical step the most
+// constrained hidden cell gets its digit from the solution.
+template <int SECTION_LEN>
+void findHint(const BasicBoard<SECTION_LEN> *digits, const BasicBoard<SECTION_LEN> *solution, Hint *hint) {
+      using Size = BoardSize<SECTION_LEN>;
+
+      hint->cell = -1;
+      hint->mistakesCount = 0;
+      hint->technique = REVEALING_STEP;
+
+      for (int cell = 0; cell < Size::CELLS_COUNT; cell++) {
+            if (isMistakenCell(digits, solution, cell) && hint->mistakesCount++ == 0) {
+                  hint->cell = cell;
+                  hint->digit = solution->digits[cell];
+            }
+      }
+
+      if (hint->mistakesCount != 0) return;
+
+      bool isFound;
+
+      if constexpr (SECTION_LEN == BOARD_SECTION_LEN) {
+            isFound = findLogicalStep(digits, hint);
+      } else {
+            typename Size::Mask candidates[Size::CELLS_COUNT];
+
+            for (int cell = 0; cell < Size::CELLS_COUNT; cell++)
+                  candidates[cell] = digits->digits[cell] == 0 ? getCandidatesMask(digits, cell) : 0;
+
+            isFound = findSingle<SECTION_LEN>(candidates, hint);
+      }
+
+      if (isFound) return;
+
+      int fewestCandidatesCount = Size::DIMENSION + 1;
+
+      for (int cell = 0; cell < Size::CELLS_COUNT; cell++) {
+            if (digits->digits[cell] != 0) continue;
+
+            const int candidatesCount = __builtin_popcount(getCandidatesMask(digits, cell));
+
+            if (candidatesCount < fewestCandidatesCount) {
+                  fewestCandidatesCount = candidatesCount;
+                  hint->cell = cell;
+                  hint->digit = solution->digits[cell];
+            }
+      }
+}
+
+// The first hidden single, which the grader rates cheapest, or else the first naked single.
+template <int SECTION_LEN>
+bool findSingle(const typename BoardSize<SECTION_LEN>::Mask *candidates, Hint *hint) {
+      using Size = BoardSize<SECTION_LEN>;
+      using Mask = typename Size::Mask;
+
+      const CellLayout<SECTION_LEN> &layout = CELL_LAYOUT<SECTION_LEN>;
+
+      for (int unit = 0; unit < Size::UNITS_COUNT; unit++) {
+            Mask onceMask = 0, twiceMask = 0;
+
+            for (int cell : layout.unitCells[unit]) {
+                  twiceMask |= onceMask & candidates[cell];
+                  onceMask |= candidates[cell];
+            }
+
+            const Mask singles = onceMask & ~twiceMask;
+
+            if (singles == 0) continue;
+
+            const Mask bit = singles & -singles;
+
+            for (int cell : layout.unitCells[unit]) {
+                  if (candidates[cell] & bit) {
+                        hint->cell = cell;
+                        hint->digit = __builtin_ctz(bit) + 1;
+                        hint->technique = Technique::HiddenSingle;
+
+                        return true;
+                  }
+            }
+      }
+
+      for (int cell = 0; cell < Size::CELLS_COUNT; cell++) {
+            const Mask cellCandidates = candidates[cell];
+
+            if (cellCandidates != 0 && (cellCandidates & (cellCandidates - 1)) == 0) {
+                  hint->cell = cell;
+                  hint->digit = __builtin_ctz(cellCandidates) + 1;
+                  hint->technique = Technique::NakedSingle;
+
+                  return true;
+            }
+      }
+
+      return false;
+}
+
+template <int SECTION_LEN>
+bool isMistakenCell(const BasicBoard<SECTION_LEN> *digits, const BasicBoard<SECTION_LEN> *solution,
+                    const int cell) {
+      return digits->digits[cell] != 0 && digits->digits[cell] != solution->digits[cell];
+}
+
+template <int SECTION_LEN>
+void copyDigits(BasicBoard<SECTION_LEN> *from, BasicBoard<SECTION_LEN> *to) {
+      *to = *from;
+}
+
+template <int SECTION_LEN>
+void refreshField(BasicBoard<SECTION_LEN> *currentDigits, BasicBoard<SECTION_LEN> *defaultDigits,
+                  Progress<SECTION_LEN> *progress, const int dimension, int *playerPosY, int *playerPosX,
+                  int *initialDigitsShownCount) {
+      copyDigits(defaultDigits, currentDigits);
+
+      resetProgress(progress, currentDigits, defaultDigits);
+
+      refreshCurrentData(defaultDigits, dimension, playerPosY, playerPosX, initialDigitsShownCount);
+}
+
+template <int SECTION_LEN>
+void refreshCurrentData(BasicBoard<SECTION_LEN> *defaultDigits, const int dimension, int *playerPosY,
+                        int *playerPosX, int *initialDigitsShownCount) {
+      const int MIDDLE = dimension / 2;
+
+      *playerPosX = *playerPosY = MIDDLE;
+
+      *initialDigitsShownCount = getCountOfShownDigits(defaultDigits, dimension);
+}
+
+template <int SECTION_LEN>
+void recreateDigits(BasicBoard<SECTION_LEN> *currentDigits, BasicBoard<SECTION_LEN> *defaultDigits,
+                    BasicBoard<SECTION_LEN> *solvedMtrx, Progress<SECTION_LEN> *progress, const PuzzleDb *db,
+                    PuzzlePool<SECTION_LEN> *pool, Random *random, const int dimension, int *playerPosY,
+                    int *playerPosX, int *initialDigitsShownCount) {
+      initDigits(defaultDigits, solvedMtrx, currentDigits, db, pool, random);
+
+      resetProgress(progress, currentDigits, defaultDigits);
+
+      refreshCurrentData(defaultDigits, dimension, playerPosY, playerPosX, initialDigitsShownCount);
+}
+
+// The first field of a session comes from the database or the generator, never from a pool, so the
+// (seed, stream) pair alone gives it.
+template <int SECTION_LEN>
+void startGameSession(GameSession<SECTION_LEN> *session, const uint64_t seed, const uint64_t stream,
+                      const PuzzleDb *db) {
+      const int DIMENSION = BoardSize<SECTION_LEN>::DIMENSION;
+
+      *session = GameSession<SECTION_LEN>{};
+      seedRandom(&session->random, seed, stream);
+
+      recreateDigits(&session->currentDigits, &session->defaultDigits, &session->solvedMtrx,
+                     &session->progress, db, (PuzzlePool<SECTION_LEN> *)nullptr, &session->random, DIMENSION,
+                     &session->playerPosY, &session->playerPosX, &session->initialDigitsShownCount);
+
+      session->isMenuShown = true;
+}
+
+// digit is the one PutDigit shows, 1..DIMENSION; the other actions ignore it.
+template <int SECTION_LEN>
+void doSessionAction(GameSession<SECTION_LEN> *session, const SessionAction action, const int digit,
+                     const PuzzleDb *db, PuzzlePool<SECTION_LEN> *pool) {
+      const int DIMENSION = BoardSize<SECTION_LEN>::DIMENSION;
+
+      int *playerPosX = &session->playerPosX;
+      int *playerPosY = &session->playerPosY;
+
+      switch (action) {
+            case SessionAction::MoveUp:
+                  *playerPosY = (*playerPosY) - 1 != -1 ? (*playerPosY) - 1 : (*playerPosY);
+                  break;
+            case SessionAction::MoveDown:
+                  *playerPosY = (*playerPosY) + 1 != DIMENSION ? (*playerPosY) + 1 : (*playerPosY);
+                  break;
+            case SessionAction::MoveLeft:
+                  *playerPosX = (*playerPosX) - 1 != -1 ? (*playerPosX) - 1 : (*playerPosX);
+                  break;
+            case SessionAction::MoveRight:
+                  *playerPosX = (*playerPosX) + 1 != DIMENSION ? (*playerPosX) + 1 : (*playerPosX);
+                  break;
+            case SessionAction::PutDigit:
+                  changeSell(&session->currentDigits, &session->defaultDigits, &session->progress,
+                             *playerPosY, *playerPosX, digit);
+                  break;
+            case SessionAction::ClearDigit:
+                  clearSell(&session->currentDigits, &session->defaultDigits, &session->progress,
+                            *playerPosY, *playerPosX);
+                  break;
+            case SessionAction::ResetField:
+                  refreshField(&session->currentDigits, &session->defaultDigits, &session->progress,
+                               DIMENSION, playerPosY, playerPosX, &session->initialDigitsShownCount);
+                  break;
+            case SessionAction::NewField:
+                  recreateDigits(&session->currentDigits, &session->defaultDigits, &session->solvedMtrx,
+                                 &session->progress, db, pool, &session->random, DIMENSION, playerPosY,
+                                 playerPosX, &session->initialDigitsShownCount);
+                  break;
+            case SessionAction::ShowMenu:
+                  session->isMenuShown = true;
+                  break;
+            case SessionAction::HideMenu:
+                  session->isMenuShown = false;
+                  break;
+      }
+}
+
+// The next step, as the hint of the game shows it, with the player moved to its cell.
+template <int SECTION_LEN>
+void takeSessionHint(GameSession<SECTION_LEN> *session, Hint *hint) {
+      const int DIMENSION = BoardSize<SECTION_LEN>::DIMENSION;
+
+      findHint(&session->currentDigits, &session->solvedMtrx, hint);
+
+      if (hint->cell != -1) {
+            session->playerPosX = hint->cell % DIMENSION;
+            session->playerPosY = hint->cell / DIMENSION;
+      }
+}
+
+template <int SECTION_LEN>
+void clearSell(BasicBoard<SECTION_LEN> *currentDigits, BasicBoard<SECTION_LEN> *defaultDigits,
+               Progress<SECTION_LEN> *progress, const int row, const int col) {
+      if (!isDefaultDigit(currentDigits, defaultDigits, row, col)) {
+            updateProgress(progress, currentDigits, defaultDigits, row, col, 0);
+      }
+}
+
+template <int SECTION_LEN>
+void changeSell(BasicBoard<SECTION_LEN> *currentDigits, BasicBoard<SECTION_LEN> *defaultDigits,
+                Progress<SECTION_LEN> *progress, const int row, const int col, const int digit) {
+      if (!isDefaultDigit(currentDigits, defaultDigits, row, col)) {
+            updateProgress(progress, currentDigits, defaultDigits, row, col, digit);
+      }
+}
+
+template <typename T>
+void putText(Screen *screen, const int fgColor, const int bgColor, const T text) {
+      if constexpr (std::is_same_v<T, char>) {
+            putGlyph(screen, fgColor, bgColor, text);
+      } else if constexpr (std::is_integral_v<T>) {
+            char digits[24];
+            snprintf(digits, sizeof(digits), "%lld", (long long)text);
+            putText(screen, fgColor, bgColor, (const char *)digits);
+      } else {
+            for (const char *glyph = text; *glyph != '\0'; glyph++)
+                  putGlyph(screen, fgColor, bgColor, *glyph);
+      }
+}
+
+template <int SECTION_LEN>
+int getDigit(const BasicBoard<SECTION_LEN> *board, const int row, const int col) {
+      return board->digits[row * BoardSize<SECTION_LEN>::DIMENSION + col];
+}
+
+template <int SECTION_LEN>
+void setDigit(BasicBoard<SECTION_LEN> *board, const int cell, const int digit) {
+      const int HIDDEN_DIGIT = 0;
+
+      const int previousDigit = board->digits[cell];
+
+      if (previousDigit == digit) return;
+
+      if (previousDigit != HIDDEN_DIGIT) updateUnitsOfCell(board, cell, previousDigit, -1);
+      if (digit != HIDDEN_DIGIT) updateUnitsOfCell(board, cell, digit, +1);
+
+      board->digits[cell] = digit;
+}
+
+template <int SECTION_LEN>
+void updateUnitsOfCell(BasicBoard<SECTION_LEN> *board, const int cell, const int digit, const int delta) {
+      const CellLayout<SECTION_LEN> &layout = CELL_LAYOUT<SECTION_LEN>;
+      const int unitIndices[UNIT_KINDS_COUNT] = {layout.cellRows[cell], layout.cellCols[cell],
+                                                 layout.cellSections[cell]};
+      const uint32_t bit = getDigitBit(digit);
+
+      for (int kind = 0; kind < UNIT_KINDS_COUNT; kind++) {
+            const int unit = unitIndices[kind];
+            const int count = board->digitCounts[kind][unit][digit - 1] += delta;
+
+            board->usedMasks[kind][unit] =
+                count > 0 ? board->usedMasks[kind][unit] | bit : board->usedMasks[kind][unit] & ~bit;
+            board->conflictMasks[kind][unit] =
+                count > 1 ? board->conflictMasks[kind][unit] | bit : board->conflictMasks[kind][unit] & ~bit;
+      }
+}
+
+template <int SECTION_LEN>
+int getSectionIndex(const int row, const int col) {
+      return CELL_LAYOUT<SECTION_LEN>.cellSections[row * BoardSize<SECTION_LEN>::DIMENSION + col];
+}
+
+inline uint32_t getDigitBit(const int digit) { return 1u << (digit - 1); }
+
+// Digits which no other cell of the row, column and section uses yet. Meant for hidden cells:
+// a shown digit is reported as used by its own units.
+template <int SECTION_LEN>
+typename BoardSize<SECTION_LEN>::Mask getCandidatesMask(const BasicBoard<SECTION_LEN> *board,
+                                                        const int cell) {
+      const CellLayout<SECTION_LEN> &layout = CELL_LAYOUT<SECTION_LEN>;
+
+      return BoardSize<SECTION_LEN>::ALL_DIGITS_MASK &
+             ~(board->usedMasks[ROW_UNIT][layout.cellRows[cell]] |
+               board->usedMasks[COL_UNIT][layout.cellCols[cell]] |
+               board->usedMasks[SECTION_UNIT][layout.cellSections[cell]]);
+}
+
+template <int SECTION_LEN>
+int getCandidatesCount(const BasicBoard<SECTION_LEN> *board, const int cell) {
+      return __builtin_popcount(getCandidatesMask(board, cell));
+}
+
+// Digit of the n-th (0-based) set bit of the mask.
+inline int getNthDigitOfMask(uint32_t mask, int n) {
+      for (; n > 0; n--) mask &= mask - 1;
+
+      return __builtin_ctz(mask) + 1;
+}
+
+// Digits above 9 are shown as capital letters, 10 as 'A' up to 25 as 'P'.
+inline char getDigitChar(const int digit) {
+      const char DIGIT_CHARS[] = "0123456789ABCDEFGHIJKLMNOP";
+
+      return DIGIT_CHARS[digit];
+}
+
+// Inverse of getDigitChar, 0 for characters which aren't a digit from 1 up.
+inline int getCharDigit(const char digitChar) {
+      const int MAX_DECIMAL_DIGIT = 9;
+
+      if (digitChar >= '1' && digitChar <= '9') return digitChar - '0';
+      if (digitChar >= 'A' && digitChar <= 'P') return MAX_DECIMAL_DIGIT + 1 + digitChar - 'A';
+
+      return 0;
+}
+
+inline uint64_t getStatsClock() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+}
+
+// Hot loops count into a local variable and pass the total once.
+inline void countStat(const StatCounter counter, const uint64_t amount) {
+      if constexpr (SUDOKU_STATS) {
+            if (statsMode != 0) getThreadStatsShard()->counts[counter] += amount;
+      }
+}
+
+// 0 while the stats are off, which stopStatTimer then ignores.
+inline uint64_t startStatTimer() {
+      if constexpr (SUDOKU_STATS) {
+            if (statsMode != 0) return getStatsClock();
+      }
+
+      return 0;
+}
+
+inline void stopStatTimer(const StatHistogram histogram, const uint64_t startNs) {
+      if constexpr (SUDOKU_STATS) {
+            if (statsMode != 0 && startNs != 0)
+                  recordStatSample(histogram, startNs, getStatsClock() - startNs);
+      }
+}
+
+inline void recordStatValue(const StatHistogram histogram, const uint64_t value) {
+      if constexpr (SUDOKU_STATS) {
+            if (statsMode != 0) recordStatSample(histogram, getStatsClock(), value);
+      }
+}
+
+template <int SECTION_LEN>
+Color getFgColor(BasicBoard<SECTION_LEN> *digits, BasicBoard<SECTION_LEN> *defaultDigits,
+                 const Progress<SECTION_LEN> *progress, const int row, const int col, const int playerPosX,
+                 const int playerPosY) {
+      const int HIDDEN_DIGIT = 0;
+      const int cell = row * BoardSize<SECTION_LEN>::DIMENSION + col;
+
+      Color result;
+
+      bool isDefaultDigit = getDigit(defaultDigits, row, col) == getDigit(digits, row, col);
+      bool isShownDigit = getDigit(digits, row, col) != HIDDEN_DIGIT;
+
+      if (row == playerPosY && col == playerPosX)
+            result = Color::CyanFg;
+      else if (progress->conflictsCounts[cell] != 0 && !isDefaultDigit && isShownDigit)
+            result = Color::RedFg;
+      else if (isDefaultDigit && isShownDigit)
+            result = Color::YellowFg;
+      else if (!isDefaultDigit)
+            result = Color::GreenFg;
+      else
+            result = Color::BlackFg;
+
+      return result;
+}
+
+template <int SECTION_LEN>
+int getCountOfShownDigits(BasicBoard<SECTION_LEN> *defaultDigits, const int dimension) {
+      int result = 0;
+      const int HIDDEN_DIGIT = 0;
+
+      for (int i = 0; i < dimension; i++)
+            for (int j = 0; j < dimension; j++)
+                  result = getDigit(defaultDigits, i, j) != HIDDEN_DIGIT ? result + 1 : result;
+
+      return result;
+}
+
+template <int SECTION_LEN>
+bool isDefaultDigit(BasicBoard<SECTION_LEN> *currentDigits, BasicBoard<SECTION_LEN> *defaultDigits,
+                    const int row, const int col) {
+      return (getDigit(currentDigits, row, col) == getDigit(defaultDigits, row, col)) &&
+             (getDigit(defaultDigits, row, col) != 0);
+}
+
+template <int SECTION_LEN>
+bool isEnteredDigitCorrect(BasicBoard<SECTION_LEN> *digits, const int row, const int col) {
+      const int digit = getDigit(digits, row, col);
+
+      if (digit == 0) return true;
+
+      const uint32_t conflicts = digits->conflictMasks[ROW_UNIT][row] | digits->conflictMasks[COL_UNIT][col] |
+                                 digits->conflictMasks[SECTION_UNIT][getSectionIndex<SECTION_LEN>(row, col)];
+
+      return (conflicts & getDigitBit(digit)) == 0;
+}
+
+#endif  // SUDOKU_H
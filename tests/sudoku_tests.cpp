@@ -0,0 +1,429 @@
+// sudoku_tests.cpp - deterministic checks of the engine: kernels, solvers, grader, hints, canonical
+// forms and the puzzle database
+#include "sudoku.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef SUDOKU_TEST_CORPUS
+#define SUDOKU_TEST_CORPUS "bench/corpus.txt"
+#endif
+
+const uint64_t TEST_SEED = 2026;
+const char *const EMPTY_PUZZLE =
+    ".................................................................................";
+const int CANONICAL_CHECKS_COUNT = 200;
+
+// Puzzles of the corpus of sudoku_bench, which covers every difficulty and minimal puzzles.
+struct TestCorpus {
+      std::vector<Board> puzzles, solutions;
+};
+
+typedef bool (*TestFunction)(const TestCorpus *corpus);
+
+struct TestCase {
+      const char *name;
+      TestFunction run;
+};
+
+struct RatingCase {
+      const char *puzzle;
+      int rating;
+};
+
+// Position of the player in a game of puzzle, and the hint it should get.
+struct HintCase {
+      const char *puzzle;
+      const char *position;
+      int cell, digit;
+      int technique;
+      int mistakesCount;
+};
+
+const RatingCase RATING_CASES[] = {
+      {".7......1.183...79.4.5176....2.3.9...6.7284..83.9...27.9317..6.1..2.4..5..6..37.4", 10},
+      {".7....2...1.3..5.9.4.5.7..87........9....8....349..12.4.3..5.6....2..39...6.93..4", 15},
+      {"..15.7...53...2..49...4..15.54.68..7.............15.26..3..1.4...5.2...368.7..5..", 20},
+      {"..4.....9...3.9.1.9..68.2...3..1........4.7..752..64....9.6..5.1.6..7.........1.2", 30},
+      {"7...4.....3......6....8.237..4..5.......2.1..5..83..6.67...38.93...1...4.4.7...1.", 35},
+      {"....53.........3..2.1....5.....7...9.1..4..3.3.5.86...8..1..7.......76.5.7.56..93", 45},
+      {"728......5..2..4......5...1...6.4.2.8....53...4..3....6..38........6..9.9.3.4..15", MAX_RATING},
+};
+
+const HintCase HINT_CASES[] = {
+      {".7......1.183...79.4.5176....2.3.9...6.7284..83.9...27.9317..6.1..2.4..5..6..37.4",
+       ".7......1.183...79.4.5176....2.3.9...6.7284..83.9...27.9317..6.1..2.4..5..6..37.4", 13, 4,
+       Technique::HiddenSingle, 0},
+      {"....53.........3..2.1....5.....7...9.1..4..3.3.5.86...8..1..7.......76.5.7.56..93",
+       "....539..5...123..231.9..5....3715.9.1..45.3.3.5.86...8561397....3.276.5.7256..93", 28, 2,
+       Technique::LockedCandidates, 0},
+      {"..4.....9...3.9.1.9..68.2...3..1........4.7..752..64....9.6..5.1.6..7.........1.2",
+       "..4.....9...3.9.1491.6842.5438712596691.4.72.752..64.1..9.6..571.6..794.......162", 71, 3,
+       Technique::NakedPair, 0},
+      {".7......1.183...79.4.5176....2.3.9...6.7284..83.9...27.9317..6.1..2.4..5..6..37.4",
+       "67..9...1.183...79.4.5176....2.3.9...6.7284..83.9...27.9317..6.1..2.4..5..6..37.4", 0, 3,
+       REVEALING_STEP, 2},
+};
+
+bool loadTestCorpus(const char *path, TestCorpus *corpus);
+bool parseTestPuzzle(const char *line, Board *puzzle);
+bool testPropagationKernels(const TestCorpus *corpus);
+bool testSolverBackends(const TestCorpus *corpus);
+bool testGrader(const TestCorpus *corpus);
+bool testCanonicalForm(const TestCorpus *corpus);
+bool testPuzzleDb(const TestCorpus *corpus);
+bool testHints(const TestCorpus *corpus);
+bool isSameSolverState(const SolverState<BOARD_SECTION_LEN> *state,
+                       const SolverState<BOARD_SECTION_LEN> *other);
+bool checkKernelsOnState(const SolverState<BOARD_SECTION_LEN> *state);
+bool checkBackendsOnPuzzle(const Board *puzzle);
+void transformPuzzle(const Board *puzzle, Random *random, Board *transformed);
+
+const TestCase TEST_CASES[] = {
+      {"propagation-kernels", testPropagationKernels},
+      {"solver-backends", testSolverBackends},
+      {"grader", testGrader},
+      {"canonical-form", testCanonicalForm},
+      {"puzzle-db", testPuzzleDb},
+      {"hints", testHints},
+};
+
+int main(int argc, char *argv[]) {
+      const char *corpusPath = argc > 1 ? argv[1] : SUDOKU_TEST_CORPUS;
+
+      TestCorpus corpus;
+
+      if (!loadTestCorpus(corpusPath, &corpus)) {
+            std::cerr << "Can't read " << corpusPath << " as a corpus of 9x9 puzzles." << std::endl;
+
+            return 1;
+      }
+
+      int failedCount = 0;
+
+      for (const TestCase &test : TEST_CASES) {
+            const bool isPassed = test.run(&corpus);
+
+            if (!isPassed) failedCount++;
+
+            std::cerr << test.name << ": " << (isPassed ? "ok" : "FAILED") << std::endl;
+      }
+
+      return failedCount == 0 ? 0 : 1;
+}
+
+// Keeps the puzzles of the corpus with a unique solution, like sudoku_bench does.
+bool loadTestCorpus(const char *path, TestCorpus *corpus) {
+      const char *data = nullptr;
+      size_t size = 0;
+      std::vector<char> stdinData;
+
+      if (!loadInput(path, &data, &size, &stdinData)) return false;
+
+      std::vector<SolveTask> tasks;
+
+      for (size_t offset = 0; offset < size;) {
+            offset = collectSolveTasks(data, size, offset, &tasks);
+
+            for (const SolveTask &task : tasks) {
+                  Board puzzle, solution;
+
+                  if (!parsePuzzleLine(task.line, task.lineLength, &puzzle)) continue;
+                  if (findSolutions(&puzzle, 2, &solution, SolverBackend::Bitmask) != 1) continue;
+
+                  corpus->puzzles.push_back(puzzle);
+                  corpus->solutions.push_back(solution);
+            }
+      }
+
+      if (size != 0) munmap((void *)data, size);
+
+      return !corpus->puzzles.empty();
+}
+
+bool parseTestPuzzle(const char *line, Board *puzzle) {
+      return parsePuzzleLine(line, strlen(line), puzzle);
+}
+
+// The SSE2 and AVX2 kernels end up in the same state as the scalar one, from the puzzles of the
+// corpus and from every guess on their first hidden cell, wrong guesses included.
+bool testPropagationKernels(const TestCorpus *corpus) {
+      for (const Board &puzzle : corpus->puzzles) {
+            SolverState<BOARD_SECTION_LEN> state;
+
+            if (!initSolverState(&state, &puzzle) || !checkKernelsOnState(&state)) return false;
+
+            int cell = 0;
+            while (state.digits[cell] != 0) cell++;
+
+            for (uint32_t candidates = getSolverCandidates(&state, cell); candidates != 0;
+                 candidates &= candidates - 1) {
+                  SolverState<BOARD_SECTION_LEN> guessState = state;
+
+                  placeSolverDigit(&guessState, cell, __builtin_ctz(candidates) + 1);
+
+                  if (!checkKernelsOnState(&guessState)) return false;
+            }
+      }
+
+      return true;
+}
+
+bool checkKernelsOnState(const SolverState<BOARD_SECTION_LEN> *state) {
+      SolverState<BOARD_SECTION_LEN> scalarState = *state;
+
+      const bool isConsistent = propagateSingles(&scalarState);
+
+      for (int kernel = PropagationKernel::Sse2; kernel < PROPAGATION_KERNELS_COUNT; kernel++) {
+            if (!isPropagationKernelSupported((PropagationKernel)kernel)) continue;
+
+            SolverState<BOARD_SECTION_LEN> kernelState = *state;
+
+            const bool isKernelConsistent = kernel == PropagationKernel::Sse2
+                                                ? propagateSinglesWithSse2(&kernelState)
+                                                : propagateSinglesWithAvx2(&kernelState);
+
+            // A contradiction may be found at different points, so only consistent states are compared.
+            if (isKernelConsistent != isConsistent ||
+                (isConsistent && !isSameSolverState(&kernelState, &scalarState))) {
+                  std::cerr << "  " << PROPAGATION_KERNEL_NAMES[kernel] << " differs from scalar"
+                            << std::endl;
+
+                  return false;
+            }
+      }
+
+      return true;
+}
+
+bool isSameSolverState(const SolverState<BOARD_SECTION_LEN> *state,
+                       const SolverState<BOARD_SECTION_LEN> *other) {
+      return memcmp(state->digits, other->digits, sizeof(state->digits)) == 0 &&
+             memcmp(state->usedMasks, other->usedMasks, sizeof(state->usedMasks)) == 0 &&
+             state->hiddenCount == other->hiddenCount;
+}
+
+// Dancing Links counts and finds the same solutions as the bitmask search, on the corpus and on an
+// empty field, a field without a solution and one whose digits conflict.
+bool testSolverBackends(const TestCorpus *corpus) {
+      const char *const EDGE_PUZZLES[] = {
+            EMPTY_PUZZLE,
+            "12345678.........9...............................................................",
+            "11...............................................................................",
+      };
+
+      for (const Board &puzzle : corpus->puzzles)
+            if (!checkBackendsOnPuzzle(&puzzle)) return false;
+
+      for (const char *line : EDGE_PUZZLES) {
+            Board puzzle;
+
+            if (!parseTestPuzzle(line, &puzzle) || !checkBackendsOnPuzzle(&puzzle)) return false;
+      }
+
+      return true;
+}
+
+// Both go up to a second solution; the first one is compared only when it's the only one, since the
+// backends search in different orders.
+bool checkBackendsOnPuzzle(const Board *puzzle) {
+      Board bitmaskSolution, dlxSolution;
+
+      const int bitmaskCount = findSolutions(puzzle, 2, &bitmaskSolution, SolverBackend::Bitmask);
+      const int dlxCount = findSolutions(puzzle, 2, &dlxSolution, SolverBackend::DancingLinks);
+
+      if (bitmaskCount != dlxCount ||
+          (bitmaskCount == 1 && memcmp(bitmaskSolution.digits, dlxSolution.digits, BOARD_CELLS_COUNT) != 0)) {
+            std::cerr << "  bitmask found " << bitmaskCount << " solutions and dlx " << dlxCount << std::endl;
+
+            return false;
+      }
+
+      return true;
+}
+
+// A puzzle of every rating the corpus has, and one which needs guessing.
+bool testGrader(const TestCorpus *) {
+      for (const RatingCase &ratingCase : RATING_CASES) {
+            Board puzzle;
+
+            if (!parseTestPuzzle(ratingCase.puzzle, &puzzle)) return false;
+
+            const Grade grade = gradePuzzle(&puzzle);
+
+            if (grade.rating != ratingCase.rating || grade.isSolved != (ratingCase.rating != MAX_RATING)) {
+                  std::cerr << "  " << ratingCase.puzzle << " rated " << grade.rating << " instead of "
+                            << ratingCase.rating << std::endl;
+
+                  return false;
+            }
+      }
+
+      return true;
+}
+
+// A puzzle and a random transformation of it have the same canonical digits and hash, and the
+// canonical form is its own canonical form.
+bool testCanonicalForm(const TestCorpus *corpus) {
+      Canonicalizer canonicalizer;
+      Random random;
+
+      seedRandom(&random, TEST_SEED, 0);
+
+      const size_t checksCount = std::min<size_t>(CANONICAL_CHECKS_COUNT, corpus->puzzles.size());
+
+      for (size_t i = 0; i < checksCount; i++) {
+            Board transformed, canonical{};
+            uint8_t digits[BOARD_CELLS_COUNT], transformedDigits[BOARD_CELLS_COUNT],
+                canonicalDigits[BOARD_CELLS_COUNT];
+
+            transformPuzzle(&corpus->puzzles[i], &random, &transformed);
+
+            const uint64_t hash = canonicalizePuzzle(&corpus->puzzles[i], &canonicalizer, digits);
+            const uint64_t transformedHash =
+                canonicalizePuzzle(&transformed, &canonicalizer, transformedDigits);
+
+            for (int cell = 0; cell < BOARD_CELLS_COUNT; cell++) setDigit(&canonical, cell, digits[cell]);
+
+            const uint64_t canonicalHash = canonicalizePuzzle(&canonical, &canonicalizer, canonicalDigits);
+
+            if (hash != transformedHash || memcmp(digits, transformedDigits, BOARD_CELLS_COUNT) != 0 ||
+                hash != canonicalHash || memcmp(digits, canonicalDigits, BOARD_CELLS_COUNT) != 0) {
+                  std::cerr << "  puzzle " << i << " of the corpus changed its canonical form" << std::endl;
+
+                  return false;
+            }
+      }
+
+      uint8_t digits[BOARD_CELLS_COUNT];
+
+      return canonicalizePuzzle(&corpus->puzzles[0], &canonicalizer, digits) !=
+             canonicalizePuzzle(&corpus->puzzles[1], &canonicalizer, digits);
+}
+
+// Permutes the bands, the stacks, the rows and columns within them and the digits, and transposes
+// the field half of the time.
+void transformPuzzle(const Board *puzzle, Random *random, Board *transformed) {
+      const int SECTIONS_COUNT = BOARD_DIMENSION / BOARD_SECTION_LEN;
+
+      int rows[BOARD_DIMENSION], cols[BOARD_DIMENSION], labels[BOARD_DIMENSION + 1];
+
+      const int *bands = PERMUTATIONS_OF_3[getRandomInt(random, 6)];
+      const int *stacks = PERMUTATIONS_OF_3[getRandomInt(random, 6)];
+
+      for (int section = 0; section < SECTIONS_COUNT; section++) {
+            const int *bandRows = PERMUTATIONS_OF_3[getRandomInt(random, 6)];
+            const int *stackCols = PERMUTATIONS_OF_3[getRandomInt(random, 6)];
+
+            for (int i = 0; i < BOARD_SECTION_LEN; i++) {
+                  rows[section * BOARD_SECTION_LEN + i] = bands[section] * BOARD_SECTION_LEN + bandRows[i];
+                  cols[section * BOARD_SECTION_LEN + i] = stacks[section] * BOARD_SECTION_LEN + stackCols[i];
+            }
+      }
+
+      labels[0] = 0;
+      for (int digit = 1; digit <= BOARD_DIMENSION; digit++) labels[digit] = digit;
+
+      for (int digit = BOARD_DIMENSION; digit > 1; digit--)
+            std::swap(labels[digit], labels[1 + getRandomInt(random, digit)]);
+
+      const bool isTransposed = getRandomInt(random, 2) == 1;
+
+      *transformed = Board{};
+
+      for (int row = 0; row < BOARD_DIMENSION; row++) {
+            for (int col = 0; col < BOARD_DIMENSION; col++) {
+                  const int cell = isTransposed ? col * BOARD_DIMENSION + row : row * BOARD_DIMENSION + col;
+
+                  const int digit = puzzle->digits[rows[row] * BOARD_DIMENSION + cols[col]];
+
+                  setDigit(transformed, cell, labels[digit]);
+            }
+      }
+}
+
+// Packs the rating cases and a puzzle with many solutions, which is skipped, then checks that every
+// puzzle sits in the range of its rating, in input order, with its solution.
+bool testPuzzleDb(const TestCorpus *) {
+      char inputPath[64], outputPath[64];
+      snprintf(inputPath, sizeof(inputPath), "sudoku_tests_%d.txt", (int)getpid());
+      snprintf(outputPath, sizeof(outputPath), "sudoku_tests_%d.db", (int)getpid());
+
+      FILE *input = fopen(inputPath, "wb");
+
+      if (input == nullptr) return false;
+
+      fprintf(input, "%s\n", EMPTY_PUZZLE);
+      for (const RatingCase &ratingCase : RATING_CASES) fprintf(input, "%s\n", ratingCase.puzzle);
+      fclose(input);
+
+      char *packArgs[] = {(char *)"pack", (char *)"--input", inputPath, (char *)"--output", outputPath,
+                          (char *)"--threads", (char *)"2"};
+
+      const bool isPacked = runPackMode(sizeof(packArgs) / sizeof(packArgs[0]), packArgs) == 0;
+
+      unlink(inputPath);
+
+      PuzzleDb db;
+
+      if (!isPacked || !openPuzzleDb(outputPath, &db)) {
+            unlink(outputPath);
+
+            return false;
+      }
+
+      const int CASES_COUNT = sizeof(RATING_CASES) / sizeof(RATING_CASES[0]);
+
+      uint64_t ratingCounts[MAX_RATING + 1] = {};
+      bool isMatching = db.header->recordsCount == CASES_COUNT;
+
+      for (int i = 0; isMatching && i < CASES_COUNT; i++) {
+            const int rating = RATING_CASES[i].rating;
+            const uint64_t index = db.header->ratingStarts[rating] + ratingCounts[rating]++;
+
+            Board puzzle, solution;
+            uint8_t puzzleDigits[BOARD_CELLS_COUNT], solutionDigits[BOARD_CELLS_COUNT];
+
+            parseTestPuzzle(RATING_CASES[i].puzzle, &puzzle);
+            solve(&puzzle, &solution);
+            unpackDbRecord(&db.records[index], puzzleDigits, solutionDigits);
+
+            isMatching = index < db.header->ratingStarts[rating + 1] &&
+                         memcmp(puzzleDigits, puzzle.digits, BOARD_CELLS_COUNT) == 0 &&
+                         memcmp(solutionDigits, solution.digits, BOARD_CELLS_COUNT) == 0;
+      }
+
+      for (int rating = 0; isMatching && rating <= MAX_RATING; rating++)
+            isMatching =
+                db.header->ratingStarts[rating + 1] - db.header->ratingStarts[rating] == ratingCounts[rating];
+
+      closePuzzleDb(&db);
+      unlink(outputPath);
+
+      return isMatching;
+}
+
+// Hidden single, locked candidates, a naked pair and mistakes, which are pointed out before anything
+// else.
+bool testHints(const TestCorpus *) {
+      for (const HintCase &hintCase : HINT_CASES) {
+            Board puzzle, position, solution;
+
+            if (!parseTestPuzzle(hintCase.puzzle, &puzzle) ||
+                !parseTestPuzzle(hintCase.position, &position) || !solve(&puzzle, &solution))
+                  return false;
+
+            Hint hint;
+            findHint(&position, &solution, &hint);
+
+            if (hint.cell != hintCase.cell || hint.digit != hintCase.digit ||
+                hint.technique != hintCase.technique || hint.mistakesCount != hintCase.mistakesCount) {
+                  std::cerr << "  " << hintCase.position << " got cell " << hint.cell << ", digit "
+                            << hint.digit << ", " << getHintStepName(hint.technique) << std::endl;
+
+                  return false;
+            }
+      }
+
+      return true;
+}